@@ -0,0 +1,286 @@
+// Headless throughput benchmark for the shader library.
+// Renders every shader in shaders/ into an off-screen FBO at a matrix of
+// resolutions through an EGL surfaceless context (works on Mesa llvmpipe
+// without a GPU or display), reports ms/frame and megapixels/s, and compares
+// the results against a committed baseline file.
+#include "glad/glad.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "shader_utils.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+
+namespace fs = std::filesystem;
+
+struct Resolution {
+    std::string name;
+    int width;
+    int height;
+};
+
+const std::vector<Resolution> kResolutions = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+    {"8k", 7680, 4320},
+};
+
+struct BenchResult {
+    std::string shader;
+    std::string resolution;
+    double meanMs;
+    double stddevMs;
+    double minMs;
+    double megapixelsPerSec;
+};
+
+// Create a surfaceless OpenGL 3.3 core context (no window system needed)
+bool createHeadlessContext(std::string& error) {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = getPlatformDisplay
+        ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+        : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        error = "Failed to initialize EGL display";
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        error = "EGL does not support desktop OpenGL";
+        return false;
+    }
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        error = "Failed to create surfaceless OpenGL 3.3 context (EGL error " + std::to_string(eglGetError()) + ")";
+        return false;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        error = "Failed to initialize GLAD";
+        return false;
+    }
+    return true;
+}
+
+// Baseline file: one "shader resolution ms_per_frame" entry per line, '#' comments
+std::map<std::string, double> loadBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string shader, resolution;
+        double ms;
+        if (fields >> shader >> resolution >> ms) baseline[shader + " " + resolution] = ms;
+    }
+    return baseline;
+}
+
+bool writeBaseline(const std::string& path, const std::vector<BenchResult>& results, int frames) {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    file << "# GLSLStudio benchmark baseline: shader resolution ms_per_frame (mean of "
+         << frames << " frames)\n";
+    file << "# Renderer: " << glGetString(GL_RENDERER) << "\n";
+    for (const auto& r : results) {
+        file << r.shader << " " << r.resolution << " " << std::fixed << std::setprecision(3) << r.meanMs << "\n";
+    }
+    return true;
+}
+
+// Render `frames` frames of one shader at one resolution, one glFinish per frame
+bool benchmarkShader(GLuint program, GLuint VAO, const Resolution& res, int frames,
+                     BenchResult& result, std::string& error) {
+    GLuint fbo, texture;
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, res.width, res.height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!complete) {
+        error = "Framebuffer incomplete at " + res.name;
+    } else {
+        GLint iTimeLoc = glGetUniformLocation(program, "iTime");
+        GLint iResLoc = glGetUniformLocation(program, "iResolution");
+        glViewport(0, 0, res.width, res.height);
+        glUseProgram(program);
+        if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(res.width), static_cast<float>(res.height), 1.0f);
+        glBindVertexArray(VAO);
+
+        std::vector<double> samples;
+        // Frame -1 is a warm-up (driver shader variants, first-touch allocation)
+        for (int frame = -1; frame < frames; ++frame) {
+            auto start = std::chrono::steady_clock::now();
+            if (iTimeLoc != -1) glUniform1f(iTimeLoc, std::max(frame, 0) / 60.0f);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glFinish();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (frame >= 0) samples.push_back(ms);
+        }
+        glBindVertexArray(0);
+
+        double sum = 0.0, minMs = samples[0];
+        for (double ms : samples) {
+            sum += ms;
+            minMs = std::min(minMs, ms);
+        }
+        double mean = sum / samples.size();
+        double variance = 0.0;
+        for (double ms : samples) variance += (ms - mean) * (ms - mean);
+        variance /= samples.size();
+
+        result.resolution = res.name;
+        result.meanMs = mean;
+        result.stddevMs = std::sqrt(variance);
+        result.minMs = minMs;
+        result.megapixelsPerSec = (static_cast<double>(res.width) * res.height / 1.0e6) / (mean / 1000.0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    return complete;
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --shaders DIR          shader directory (default: shaders)\n"
+              << "  --frames N             timed frames per shader and resolution (default: 5)\n"
+              << "  --resolutions LIST     comma-separated subset of 720p,1080p,4k,8k (default: all)\n"
+              << "  --baseline FILE        baseline to compare against (default: bench_baseline.txt)\n"
+              << "  --threshold FRACTION   allowed slowdown before failing (default: 0.25)\n"
+              << "  --write-baseline       overwrite the baseline with this run\n"
+              << "  --software             force Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1)\n";
+}
+
+int main(int argc, char** argv) {
+    std::string shaderDir = "shaders";
+    std::string baselinePath = "bench_baseline.txt";
+    std::string resolutionList;
+    int frames = 5;
+    double threshold = 0.25;
+    bool updateBaseline = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--shaders" && i + 1 < argc) {
+            shaderDir = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--resolutions" && i + 1 < argc) {
+            resolutionList = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::atof(argv[++i]);
+        } else if (arg == "--write-baseline") {
+            updateBaseline = true;
+        } else if (arg == "--software") {
+            setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Resolution> resolutions;
+    for (const auto& res : kResolutions) {
+        if (resolutionList.empty() || ("," + resolutionList + ",").find("," + res.name + ",") != std::string::npos) {
+            resolutions.push_back(res);
+        }
+    }
+    if (resolutions.empty()) {
+        std::cerr << "No known resolutions in: " << resolutionList << "\n";
+        return 2;
+    }
+
+    std::string error;
+    if (!createHeadlessContext(error)) {
+        std::cerr << error << "\n";
+        return 2;
+    }
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << "\n";
+
+    std::vector<std::string> shaderFiles = loadShaderFiles(shaderDir, error);
+    if (shaderFiles.empty()) {
+        std::cerr << error << "\n";
+        return 2;
+    }
+    std::sort(shaderFiles.begin(), shaderFiles.end());
+
+    GLuint VAO, VBO;
+    createFullscreenQuad(VAO, VBO);
+
+    std::vector<BenchResult> results;
+    bool failed = false;
+    std::cout << std::left << std::setw(20) << "shader" << std::setw(8) << "res"
+              << std::right << std::setw(12) << "ms/frame" << std::setw(10) << "stddev"
+              << std::setw(10) << "min" << std::setw(12) << "MP/s" << "\n";
+    for (const auto& file : shaderFiles) {
+        std::string name = fs::path(file).filename().string();
+        error.clear();
+        std::string source = loadShaderFile(file, error);
+        GLuint program = 0;
+        if (source.empty() || !buildShaderProgram(expandShaderSource(source), program, error)) {
+            std::cerr << name << ": " << error << "\n";
+            failed = true;
+            continue;
+        }
+        for (const auto& res : resolutions) {
+            BenchResult result;
+            result.shader = name;
+            if (!benchmarkShader(program, VAO, res, frames, result, error)) {
+                std::cerr << name << " @ " << res.name << ": " << error << "\n";
+                failed = true;
+                continue;
+            }
+            std::cout << std::left << std::setw(20) << name << std::setw(8) << res.name << std::right
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(12) << result.meanMs << std::setw(10) << result.stddevMs
+                      << std::setw(10) << result.minMs << std::setw(12) << result.megapixelsPerSec << "\n";
+            results.push_back(result);
+        }
+        glDeleteProgram(program);
+    }
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+
+    if (updateBaseline) {
+        if (!writeBaseline(baselinePath, results, frames)) {
+            std::cerr << "Failed to write baseline: " << baselinePath << "\n";
+            return 2;
+        }
+        std::cout << "Baseline written to " << baselinePath << "\n";
+        return failed ? 1 : 0;
+    }
+
+    // Compare against the baseline; only slowdowns beyond the threshold fail
+    std::map<std::string, double> baseline = loadBaseline(baselinePath);
+    if (baseline.empty()) {
+        std::cout << "No baseline entries in " << baselinePath << ", skipping comparison\n";
+        return failed ? 1 : 0;
+    }
+    for (const auto& r : results) {
+        auto it = baseline.find(r.shader + " " + r.resolution);
+        if (it == baseline.end()) {
+            std::cout << "NEW        " << r.shader << " " << r.resolution << "\n";
+            continue;
+        }
+        double change = r.meanMs / it->second - 1.0;
+        bool regressed = change > threshold;
+        failed = failed || regressed;
+        std::cout << (regressed ? "REGRESSION " : "ok         ") << r.shader << " " << r.resolution
+                  << std::fixed << std::setprecision(2) << ": " << r.meanMs << " ms vs " << it->second
+                  << " ms (" << std::showpos << change * 100.0 << std::noshowpos << "%)\n";
+    }
+    return failed ? 1 : 0;
+}
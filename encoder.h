@@ -0,0 +1,729 @@
+#pragma once
+// Sink that feeds an encoder process (ffmpeg) from a background thread.
+// Data goes through a small bounded queue of reusable buffers (a whole frame
+// or one strip of it), so rendering overlaps the pipe write and only blocks
+// when the encoder falls behind (that wait is reported as backpressure).
+// The writer thread can also (or only) append the data to a frame store.
+//
+// Instead of one encoder process the writer can feed a SegmentPool: the stream
+// is cut every N frames into segments, each encoded by its own ffmpeg process
+// (so each starts on a keyframe), several of them running at once. The
+// segments are joined without re-encoding by the concat demuxer.
+#include "frame_manifest.h"
+#include "frame_store.h"
+#include "hash.h"
+#include "trace.h"
+#include "resources.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encoder settings for ffmpeg; the defaults are the offline render's
+struct EncodeOptions {
+    std::string codec = "libx264";
+    int crf = -1;    // -1 = codec default
+    int width = 0;   // 0 = input size; otherwise scaled by ffmpeg
+    int height = 0;
+};
+
+// Single-quote an argument for the shell (ffmpeg concat lists quote the same way)
+inline std::string shellQuote(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return quoted + "'";
+}
+
+inline std::string ffmpegCommand(int width, int height, const std::string& outputFile,
+                                 const EncodeOptions& options = EncodeOptions(), float framesPerSecond = 60.0f) {
+    std::string command = "ffmpeg -y -f rawvideo -pixel_format rgb24 -video_size " +
+                          std::to_string(width) + "x" + std::to_string(height) +
+                          " -framerate " + std::to_string(static_cast<int>(framesPerSecond)) + " -i -";
+    if (options.width > 0 && options.height > 0 && (options.width != width || options.height != height)) {
+        command += " -vf scale=" + std::to_string(options.width) + ":" + std::to_string(options.height) + ":flags=lanczos";
+    }
+    command += " -c:v " + options.codec;
+    if (options.crf >= 0) {
+        command += " -crf " + std::to_string(options.crf);
+        if (options.codec == "libvpx-vp9") command += " -b:v 0";  // constant quality mode
+    }
+    return command + " -pix_fmt yuv420p " + shellQuote(outputFile);
+}
+
+// Segment-parallel encoding: segment i goes to `<output>.partI<ext>`, written
+// by its own encoder process. The writer appends a segment's frames to a
+// spool file next to it and moves on; a feeder thread per segment streams
+// the spool into its encoder as frames arrive. Segments therefore encode
+// concurrently however slowly each encoder consumes its input, and the
+// writer only waits when `processes` segments are all still encoding. Spools
+// usually stay in the page cache and are deleted once their segment is done.
+//
+// Incremental pools keep their segments in `<output>.parts/` with a frame
+// manifest (see frame_manifest.h). A segment that may match the previous
+// manifest is only hashed, nothing is written or encoded; if it matches to
+// its end the previous part is reused. The first changed frame raises
+// probeFailed() and the rest of the segment is dropped; the renderer then
+// drains the encoder queue, calls restartSegment() and sends the segment's
+// frames again, which are encoded.
+class SegmentPool {
+public:
+    ~SegmentPool() {
+        std::string ignored;
+        close(false, ignored);
+    }
+
+    bool open(int width, int height, const std::string& output, const EncodeOptions& options, int segmentFrames,
+              int processes, size_t frameBytes, int totalFrames, bool incremental, std::string& error) {
+        if (segmentFrames <= 0 || frameBytes == 0) {
+            error = "Invalid segment length";
+            return false;
+        }
+        this->width = width;
+        this->height = height;
+        outputFile = output;
+        encodeOptions = options;
+        this->segmentFrames = segmentFrames;
+        this->frameBytes = frameBytes;
+        maxProcesses = std::max(processes, 1);
+        this->incremental = incremental;
+        this->totalFrames = totalFrames;
+        manifest = FrameManifest();
+        manifest.width = width;
+        manifest.height = height;
+        manifest.segmentFrames = segmentFrames;
+        manifest.encodeKey = ContentHash().add(ffmpegCommand(width, height, "", options)).value();
+        previous = FrameManifest();
+        if (incremental) {
+            std::error_code ec;
+            std::filesystem::create_directories(segmentDirectory(output), ec);
+            if (ec) {
+                error = "Failed to create " + segmentDirectory(output) + ": " + ec.message();
+                return false;
+            }
+            std::string manifestError;
+            if (previous.load(manifestPath(output), manifestError) && !previous.compatible(manifest)) {
+                std::cout << "Manifest of " << output << " is for other settings; encoding every segment\n";
+                previous.frames.clear();
+            }
+            if (!manifestError.empty()) std::cerr << manifestError << "\n";
+        }
+        // Segments that cover the same frames as in the previous render and
+        // still have their part
+        reusable.clear();
+        for (int start = 0; start < totalFrames; start += segmentFrames) {
+            std::error_code ec;
+            size_t index = reusable.size();
+            size_t end = static_cast<size_t>(std::min(start + segmentFrames, totalFrames));
+            size_t previousEnd = std::min(static_cast<size_t>(start + segmentFrames), previous.frames.size());
+            reusable.push_back(incremental && previousEnd == end && std::filesystem::exists(partPath(index), ec));
+        }
+        restarted = -1;
+        mismatch = false;
+        segmentOpen = false;
+        parts.clear();
+        fresh.clear();
+        segmentFill = 0;
+        frameFill = 0;
+        frameHash = StreamHash();
+        failed = false;
+        active = true;
+        return true;
+    }
+
+    bool isOpen() const { return active; }
+
+    // Append to the current frame and segment, starting the next segment at
+    // segment boundaries (writer thread)
+    bool write(const unsigned char* data, size_t bytes) {
+        while (bytes > 0 && !failed && !mismatch) {
+            if (!segmentOpen && !beginSegment()) return false;
+            size_t n = std::min(bytes, frameBytes - frameFill);
+            if (incremental) frameHash.add(data, n);
+            if (current && fwrite(data, 1, n, current->spool) != n) failed = true;
+            data += n;
+            bytes -= n;
+            frameFill += n;
+            if (frameFill == frameBytes) endFrame();
+        }
+        return !failed;
+    }
+
+    // Whether segment i is only hashed against the previous render (until it
+    // is restarted)
+    bool probes(int segment) const {
+        return segment >= 0 && segment < static_cast<int>(reusable.size()) && reusable[segment] && segment != restarted;
+    }
+
+    // The segment being probed has a changed frame (or a different length)
+    bool probeFailed() const { return mismatch; }
+
+    // Encode the probed segment after all: its frames are sent again from the
+    // first one. Only while the writer is idle (the encoder queue drained).
+    void restartSegment() {
+        size_t index = parts.size() - 1;
+        manifest.frames.resize(index * segmentFrames);
+        parts.pop_back();
+        fresh.pop_back();
+        restarted = static_cast<int>(index);
+        segmentOpen = false;
+        segmentFill = 0;
+        frameFill = 0;
+        frameHash = StreamHash();
+        mismatch = false;
+    }
+
+    // Wait for every segment, then join them into the output (`join`) or
+    // just delete them. An incremental pool that is not joined leaves the
+    // previous output, parts and manifest as they were.
+    bool close(bool join, std::string& error) {
+        if (!active) return true;
+        active = false;
+        if (segmentOpen && probing) {
+            // Cancelled while probing; nothing was written for it
+            parts.pop_back();
+            fresh.pop_back();
+            segmentOpen = false;
+        }
+        if (segmentOpen) {
+            if (!join) current->abandon = true;
+            endSegment();
+        }
+        bool ok = !failed;
+        while (!encoding.empty()) ok = finishOldest() && ok;
+        if (!ok) error = "Segment encoder failed (" + std::to_string(parts.size()) + " segments)";
+        join = join && ok && !parts.empty();
+        std::error_code ec;
+        if (incremental && join) {
+            // Publish the new parts and drop those past the new end
+            for (size_t i = 0; i < parts.size(); ++i) {
+                if (fresh[i]) std::filesystem::rename(encodePath(i), parts[i], ec);
+            }
+            size_t stale = parts.size();
+            while (std::filesystem::remove(partPath(stale), ec)) stale++;
+        }
+        std::string list = outputFile + ".parts.txt";
+        if (join) {
+            TRACE_ZONE("concat");
+            std::ofstream file(list);
+            for (const auto& part : parts) file << "file " << shellQuote(std::filesystem::absolute(part).string()) << "\n";
+            file.close();
+            std::string command = "ffmpeg -y -v error -f concat -safe 0 -i " + shellQuote(list) + " -c copy " +
+                                  shellQuote(outputFile);
+            if (!file || std::system(command.c_str()) != 0) {
+                error = "Failed to join segments: " + command;
+                ok = false;
+            }
+        }
+        std::filesystem::remove(list, ec);
+        if (incremental) {
+            for (size_t i = 0; i < parts.size(); ++i) {
+                if (fresh[i]) std::filesystem::remove(encodePath(i), ec);
+            }
+            std::string manifestError;
+            if (join && !(ok && manifest.save(manifestPath(outputFile), manifestError))) {
+                // Parts and manifest may disagree now; the next render encodes everything
+                std::filesystem::remove(manifestPath(outputFile), ec);
+                if (ok) error = manifestError;
+                ok = false;
+            }
+        } else {
+            for (const auto& part : parts) std::filesystem::remove(part, ec);
+        }
+        return ok;
+    }
+
+    // Segments of the last open(), and how many of them were taken over from
+    // the previous render (incremental pools)
+    int segments() const { return static_cast<int>(parts.size()); }
+    int reusedSegments() const { return static_cast<int>(std::count(fresh.begin(), fresh.end(), false)); }
+
+private:
+    // A segment being written and encoded. The writer appends whole frames
+    // to `spool` and publishes them in `available`; the feeder reads them
+    // back and pipes them to the encoder.
+    struct Segment {
+        std::string command;
+        std::string spoolPath;
+        FILE* spool = nullptr;  // writer side
+        std::thread feeder;
+        std::mutex mutex;
+        std::condition_variable arrived;
+        size_t available = 0;   // guarded by mutex
+        bool complete = false;  // guarded by mutex; no more frames will come
+        std::atomic<bool> abandon{false};
+        bool ok = true;         // set by the feeder
+    };
+
+    // Final path of segment i
+    std::string partPath(size_t i) const {
+        std::string extension = std::filesystem::path(outputFile).extension().string();
+        if (incremental) return (std::filesystem::path(segmentDirectory(outputFile)) / ("part" + std::to_string(i) + extension)).string();
+        return std::filesystem::path(outputFile).replace_extension("").string() + ".part" + std::to_string(i) + extension;
+    }
+
+    // Where segment i is encoded; incremental parts replace the previous ones
+    // only when the whole job succeeds
+    std::string encodePath(size_t i) const {
+        if (!incremental) return partPath(i);
+        return std::filesystem::path(partPath(i)).replace_extension("").string() + ".new" +
+               std::filesystem::path(outputFile).extension().string();
+    }
+
+    bool beginSegment() {
+        size_t index = parts.size();
+        parts.push_back(partPath(index));
+        fresh.push_back(true);
+        segmentOpen = true;
+        segmentFill = 0;
+        probing = probes(static_cast<int>(index));
+        if (probing) return true;
+        // Wait for the oldest segment while the pool is full
+        while (static_cast<int>(encoding.size()) >= maxProcesses) {
+            TRACE_ZONE("segment wait");
+            if (!finishOldest()) failed = true;
+        }
+        auto segment = std::make_unique<Segment>();
+        segment->command = ffmpegCommand(width, height, encodePath(index), encodeOptions);
+        segment->spoolPath = encodePath(index) + ".spool";
+        segment->spool = fopen(segment->spoolPath.c_str(), "wb");
+        if (!segment->spool) {
+            std::cerr << "Failed to create segment spool " << segment->spoolPath << "\n";
+            failed = true;
+            return false;
+        }
+        current = segment.get();
+        encoding.push_back(std::move(segment));
+        startFeeder(*current);
+        return true;
+    }
+
+    void startFeeder(Segment& segment) {
+        segment.feeder = std::thread([&segment] { feed(segment); });
+    }
+
+    // Feeder thread: pipe the segment's frames to its encoder as they arrive
+    static void feed(Segment& segment) {
+        trace::setThreadName("segment encoder");
+        TRACE_ZONE("segment encode");
+        FILE* pipe = popen(segment.command.c_str(), "w");
+        FILE* spool = fopen(segment.spoolPath.c_str(), "rb");
+        bool ok = pipe && spool;
+        if (!pipe) std::cerr << "Failed to open encoder pipe: " << segment.command << "\n";
+        std::vector<unsigned char> chunk(1 << 20);
+        size_t consumed = 0;
+        while (ok && !segment.abandon) {
+            size_t available;
+            {
+                std::unique_lock<std::mutex> lock(segment.mutex);
+                segment.arrived.wait(lock, [&] { return segment.available > consumed || segment.complete; });
+                available = segment.available;
+                if (available == consumed) break;  // complete
+            }
+            clearerr(spool);  // the spool grows behind a previous end of file
+            while (ok && consumed < available) {
+                size_t n = std::min(chunk.size(), available - consumed);
+                ok = fread(chunk.data(), 1, n, spool) == n && fwrite(chunk.data(), 1, n, pipe) == n;
+                consumed += n;
+            }
+        }
+        if (spool) fclose(spool);
+        if (pipe && pclose(pipe) != 0) ok = false;
+        std::error_code ec;
+        std::filesystem::remove(segment.spoolPath, ec);
+        segment.ok = ok;
+    }
+
+    // Wait for the oldest segment's encoder; false if it failed
+    bool finishOldest() {
+        Segment& segment = *encoding.front();
+        if (segment.feeder.joinable()) segment.feeder.join();
+        std::error_code ec;
+        std::filesystem::remove(segment.spoolPath, ec);  // never fed if abandoned early
+        bool ok = segment.ok || segment.abandon;
+        encoding.pop_front();
+        return ok;
+    }
+
+    void endFrame() {
+        frameFill = 0;
+        if (current) {
+            if (fflush(current->spool) != 0) failed = true;
+            {
+                std::lock_guard<std::mutex> lock(current->mutex);
+                current->available += frameBytes;
+            }
+            current->arrived.notify_one();
+        }
+        if (incremental) {
+            size_t index = manifest.frames.size();
+            manifest.frames.push_back(frameHash.value());
+            frameHash = StreamHash();
+            if (probing && (index >= previous.frames.size() || previous.frames[index] != manifest.frames.back())) {
+                mismatch = true;
+                return;
+            }
+        }
+        segmentFill++;
+        size_t start = (parts.size() - 1) * segmentFrames;
+        if (segmentFill == segmentFrames || start + segmentFill == static_cast<size_t>(totalFrames)) endSegment();
+    }
+
+    void endSegment() {
+        if (probing) {
+            // Every frame matched; reuse the part if it also had as many frames
+            size_t start = (parts.size() - 1) * segmentFrames;
+            size_t previousEnd = std::min(start + segmentFrames, previous.frames.size());
+            if (start + segmentFill != previousEnd) {
+                mismatch = true;
+                return;
+            }
+            fresh.back() = false;
+            segmentOpen = false;
+            return;
+        }
+        segmentOpen = false;
+        fclose(current->spool);
+        current->spool = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(current->mutex);
+            current->complete = true;
+        }
+        current->arrived.notify_one();
+        current = nullptr;
+    }
+
+    int width = 0;
+    int height = 0;
+    std::string outputFile;
+    EncodeOptions encodeOptions;
+    int segmentFrames = 0;
+    size_t frameBytes = 0;
+    int maxProcesses = 1;
+    bool incremental = false;
+    int totalFrames = 0;
+    FrameManifest manifest;  // of this render
+    FrameManifest previous;  // of the output being updated
+    std::vector<std::string> parts;
+    std::vector<bool> fresh;  // encoded by this render, not reused
+    std::vector<bool> reusable;  // per segment: may match the previous render
+    int restarted = -1;          // segment encoded after its probe failed
+    std::atomic<bool> mismatch{false};
+    bool segmentOpen = false;
+    int segmentFill = 0;      // frames in the current segment
+    size_t frameFill = 0;     // bytes of the current frame
+    StreamHash frameHash;
+    Segment* current = nullptr;  // segment being written, null while probing
+    bool probing = false;        // the open segment is only hashed
+    std::deque<std::unique_ptr<Segment>> encoding;  // segments whose encoder may still run
+    bool failed = false;
+    bool active = false;
+};
+
+class EncoderPipe {
+public:
+    ~EncoderPipe() {
+        std::string error;
+        close(error);
+    }
+
+    // Start the writer; with an empty command it only feeds `frameStore` and
+    // `segmentPool`
+    bool open(const std::string& command, size_t bufferBytes, int queueCapacity, std::string& error,
+              FrameStoreWriter* frameStore = nullptr, SegmentPool* segmentPool = nullptr) {
+        store = frameStore;
+        segments = segmentPool;
+        pipe = command.empty() ? nullptr : popen(command.c_str(), "w");
+        if (!pipe && !command.empty()) {
+            error = "Failed to open encoder pipe: " + command;
+            return false;
+        }
+        running = true;
+        buffers.assign(std::max(queueCapacity, 1) + 1, std::vector<unsigned char>(bufferBytes));
+        for (const auto& buffer : buffers) trackHostBuffer(buffer.data(), bufferBytes, "encoder", "queue buffer");
+        freeList.clear();
+        for (size_t i = 0; i < buffers.size(); ++i) freeList.push_back(static_cast<int>(i));
+        queue.clear();
+        current = -1;
+        submitted = processed = 0;
+        stopping = false;
+        writeFailed = false;
+        buffersWritten = 0;
+        blockedNs = 0;
+        writer = std::thread([this] { writerLoop(); });
+        return true;
+    }
+
+    bool isOpen() const { return running; }
+
+    size_t bufferSize() const { return buffers.empty() ? 0 : buffers[0].size(); }
+
+    // Buffer for the next frame or strip; blocks while every buffer is queued
+    unsigned char* acquireBuffer() {
+        TRACE_ZONE("encoder wait");
+        auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        freeCondition.wait(lock, [this] { return !freeList.empty(); });
+        current = freeList.front();
+        freeList.pop_front();
+        blockedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return buffers[current].data();
+    }
+
+    // Queue the first `bytes` of the buffer returned by the last
+    // acquireBuffer(). With `source` the writer first reads them from that
+    // file (zeros past its end); with `copy` it also appends them to that
+    // file. Either stays in use until done(ticket) for the returned ticket.
+    long long submitBuffer(size_t bytes, FILE* source = nullptr, FILE* copy = nullptr) {
+        long long ticket;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(Pending{current, bytes, source, copy});
+            current = -1;
+            ticket = ++submitted;
+        }
+        queueCondition.notify_one();
+        return ticket;
+    }
+
+    // The writer has finished with the buffer submitted under `ticket`
+    bool done(long long ticket) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return processed >= ticket;
+    }
+
+    // Buffers a producer can take without blocking
+    int freeBuffers() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<int>(freeList.size());
+    }
+
+    // The writer has taken every queued buffer; flush() without the wait
+    bool idle() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return freeList.size() == buffers.size();
+    }
+
+    // Wait until the writer has taken every queued buffer
+    void flush() {
+        TRACE_ZONE("encoder flush");
+        std::unique_lock<std::mutex> lock(mutex);
+        freeCondition.wait(lock, [this] { return freeList.size() == buffers.size(); });
+    }
+
+    // Drain the queue, stop the writer and wait for the encoder to exit
+    bool close(std::string& error) {
+        if (!running) return true;
+        running = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queueCondition.notify_one();
+        if (writer.joinable()) writer.join();
+        int status = 0;
+        if (pipe) {
+            TRACE_ZONE("pclose");
+            status = pclose(pipe);
+        }
+        pipe = nullptr;
+        store = nullptr;
+        segments = nullptr;
+        for (const auto& buffer : buffers) releaseHostBuffer(buffer.data());
+        buffers.clear();
+        if (writeFailed) {
+            error = "Encoder pipe write failed after " + std::to_string(buffersWritten) + " buffers";
+            return false;
+        }
+        if (status != 0) {
+            error = "Encoder exited with status " + std::to_string(status);
+            return false;
+        }
+        return true;
+    }
+
+    int queueDepth() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<int>(queue.size());
+    }
+
+    int queueCapacity() const { return static_cast<int>(buffers.size()) - 1; }
+
+    // Total time the producer spent waiting for a free buffer
+    double blockedMs() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return blockedNs / 1.0e6;
+    }
+
+    long long written() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return buffersWritten;
+    }
+
+private:
+    void writerLoop() {
+        trace::setThreadName("encoder writer");
+        for (;;) {
+            Pending item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                item = queue.front();
+                queue.pop_front();
+            }
+            if (item.source) {
+                TRACE_ZONE("cache read");
+                unsigned char* data = buffers[item.index].data();
+                size_t got = fread(data, 1, item.bytes, item.source);
+                if (got < item.bytes) memset(data + got, 0, item.bytes - got);
+            }
+            bool ok = true;
+            if (pipe) {
+                TRACE_ZONE("fwrite");
+                ok = fwrite(buffers[item.index].data(), 1, item.bytes, pipe) == item.bytes;
+            }
+            if (segments) {
+                TRACE_ZONE("segment write");
+                ok = segments->write(buffers[item.index].data(), item.bytes) && ok;
+            }
+            if (store) {
+                TRACE_ZONE("frame store");
+                ok = store->write(buffers[item.index].data(), item.bytes) && ok;
+            }
+            if (item.copy) {
+                // A failed write leaves the file's error flag set for its owner
+                TRACE_ZONE("cache write");
+                fwrite(buffers[item.index].data(), 1, item.bytes, item.copy);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ok) buffersWritten++;
+                else writeFailed = true;
+                processed++;
+                freeList.push_back(item.index);
+            }
+            freeCondition.notify_one();
+        }
+    }
+
+    struct Pending {
+        int index;
+        size_t bytes;
+        FILE* source;  // read into the buffer first (frame cache hit)
+        FILE* copy;    // also written here (frame cache fill)
+    };
+
+    FILE* pipe = nullptr;
+    FrameStoreWriter* store = nullptr;
+    SegmentPool* segments = nullptr;
+    bool running = false;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable queueCondition;
+    std::condition_variable freeCondition;
+    std::vector<std::vector<unsigned char>> buffers;
+    std::deque<int> freeList;
+    std::deque<Pending> queue;
+    int current = -1;
+    long long submitted = 0;  // tickets handed out by submitBuffer()
+    long long processed = 0;  // buffers the writer is done with
+    bool stopping = false;
+    bool writeFailed = false;
+    long long buffersWritten = 0;
+    long long blockedNs = 0;
+};
+
+// Encode a frame store with ffmpeg on a background thread. Uncompressed
+// frames are written to the pipe straight from the store's mapping; LZ4
+// frames are decompressed into one reused buffer.
+class StoreEncode {
+public:
+    ~StoreEncode() { cancel(); }
+
+    bool start(const std::string& storePath, const std::string& output, const EncodeOptions& options,
+               std::string& error) {
+        if (!reader.open(storePath, error)) return false;
+        if (reader.frames() == 0) {
+            error = "Frame store has no frames: " + storePath;
+            return false;
+        }
+        std::string command = ffmpegCommand(reader.width(), reader.height(), output, options, reader.framesPerSecond());
+        pipe = popen(command.c_str(), "w");
+        if (!pipe) {
+            error = "Failed to open encoder pipe: " + command;
+            return false;
+        }
+        if (reader.compressed()) {
+            frame.resize(reader.frameBytes());
+            trackHostBuffer(frame.data(), frame.size(), "store encode", "frame buffer");
+        }
+        outputFile = output;
+        worker = std::thread([this] { run(); });
+        return true;
+    }
+
+    // Stop early; ffmpeg finishes the frames it was given
+    void cancel() {
+        stopping = true;
+        if (worker.joinable()) worker.join();
+        if (!frame.empty()) releaseHostBuffer(frame.data());
+        frame.clear();
+    }
+
+    int framesDone() const { return done; }
+    int totalFrames() const { return reader.frames(); }
+    bool finished() const { return complete; }
+    // Valid once finished()
+    bool succeeded() const { return ok; }
+    const std::string& message() const { return result; }
+    const std::string& output() const { return outputFile; }
+
+private:
+    void run() {
+        trace::setThreadName("store encode");
+        TRACE_ZONE("store encode");
+        bool written = true, corrupt = false;
+        for (int i = 0; i < reader.frames() && written && !stopping; ++i) {
+            const unsigned char* data = reader.frameData(i);
+            if (!data) {
+                corrupt = !reader.readFrame(i, frame.data());
+                if (corrupt) break;
+                data = frame.data();
+            }
+            written = fwrite(data, 1, reader.frameBytes(), pipe) == reader.frameBytes();
+            if (written) done++;
+        }
+        int status = pclose(pipe);
+        pipe = nullptr;
+        bool cancelled = stopping && done < reader.frames();
+        ok = written && !corrupt && !cancelled && status == 0;
+        if (corrupt) result = "Corrupt frame " + std::to_string(done.load()) + " in frame store";
+        else if (cancelled) result = "Cancelled after " + std::to_string(done.load()) + " frames";
+        else if (!ok) result = "Encoder failed after " + std::to_string(done.load()) + " frames";
+        else result = "Saved as " + outputFile;
+        complete = true;
+    }
+
+    FrameStoreReader reader;
+    FILE* pipe = nullptr;
+    std::vector<unsigned char> frame;
+    std::string outputFile;
+    std::thread worker;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> complete{false};
+    std::atomic<int> done{0};
+    bool ok = false;     // written by the worker before complete
+    std::string result;  // likewise
+};
@@ -0,0 +1,193 @@
+#pragma once
+// Content-addressed cache of offline frames on disk. A frame's key is a hash
+// of everything that decides its pixels: the expanded shader source, the
+// uniform values (iTime, iResolution and, with motion blur, the shutter
+// interval), the quality settings (SSAA factor and filter, motion blur
+// samples and shutter angle) and the pixel format. Tiling and strip
+// streaming are left out since they produce identical frames. Rendering the
+// same job again, to another file name, bitrate or container, then reads the
+// frames from disk instead of drawing them.
+//
+// Each frame is one file `<key>.frame`: a header (magic, key, byte count)
+// followed by the rgb24 rows in GL order, exactly as piped to the encoder.
+// Frames are written to a temporary file and renamed when complete. The
+// directory is kept under budgetMB by deleting the least recently used frames;
+// a hit refreshes the file time, so use survives restarts.
+#include "hash.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class FrameCache {
+public:
+    static constexpr char kMagic[8] = {'G', 'S', 'F', 'R', 'A', 'M', 'E', '1'};
+
+    bool enabled = true;
+    int budgetMB = 4096;
+    std::string directory = ".glslstudio_cache/frames";
+
+    // Open the frame for reading, positioned at its pixels; null on a miss.
+    // The caller closes the file.
+    FILE* openFrame(uint64_t key, size_t bytes) {
+        loadIndex();
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.bytes != sizeof(Header) + bytes) {
+            misses++;
+            return nullptr;
+        }
+        std::string path = framePath(key);
+        FILE* file = fopen(path.c_str(), "rb");
+        Header header;
+        if (!file || fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+            header.key != key || header.bytes != bytes) {
+            if (file) fclose(file);
+            std::cerr << "Dropping unreadable cached frame " << path << "\n";
+            remove(key);
+            misses++;
+            return nullptr;
+        }
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        touch(it->first, it->second);
+        hits++;
+        return file;
+    }
+
+    // Start writing a frame; null if the cache directory is not writable
+    FILE* createFrame(uint64_t key, size_t bytes) {
+        loadIndex();
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        FILE* file = fopen((framePath(key) + ".tmp").c_str(), "wb");
+        if (!file) {
+            if (!warned) std::cerr << "Frame cache is not writable: " << directory << "\n";
+            warned = true;
+            return nullptr;
+        }
+        Header header;
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.key = key;
+        header.bytes = bytes;
+        fwrite(&header, sizeof(header), 1, file);
+        return file;
+    }
+
+    // Close a frame from createFrame() and publish it, unless `keep` is false
+    // or a write failed; then evict down to the budget
+    void commitFrame(FILE* file, uint64_t key, bool keep) {
+        if (!file) return;
+        keep = !ferror(file) && keep;
+        keep = fclose(file) == 0 && keep;
+        std::string path = framePath(key);
+        std::error_code ec;
+        if (!keep) {
+            std::filesystem::remove(path + ".tmp", ec);
+            return;
+        }
+        std::filesystem::rename(path + ".tmp", path, ec);
+        if (ec) return;
+        uintmax_t size = std::filesystem::file_size(path, ec);
+        if (ec) return;
+        Entry& entry = entries[key];
+        totalBytes -= entry.bytes;
+        entry.bytes = static_cast<size_t>(size);
+        totalBytes += entry.bytes;
+        touch(key, entry);
+        evict(key);
+    }
+
+    int hitCount() const { return hits; }
+    int missCount() const { return misses; }
+    int frameCount() const { return static_cast<int>(entries.size()); }
+    size_t sizeBytes() const { return totalBytes; }
+
+private:
+    struct Header {
+        char magic[8];
+        uint64_t key;
+        uint64_t bytes;
+    };
+
+    struct Entry {
+        size_t bytes = 0;
+        uint64_t lastUse = 0;  // 0 until it is in byUse
+    };
+
+    std::string framePath(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.frame", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    // Find the frames already on disk, ordered by file time (once)
+    void loadIndex() {
+        if (loaded) return;
+        loaded = true;
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        std::vector<std::pair<fs::file_time_type, std::pair<uint64_t, size_t>>> found;
+        for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->path().extension() != ".frame") continue;
+            std::string stem = it->path().stem().string();
+            char* parsed = nullptr;
+            uint64_t key = strtoull(stem.c_str(), &parsed, 16);
+            std::error_code fileError;
+            uintmax_t size = it->file_size(fileError);
+            fs::file_time_type time = it->last_write_time(fileError);
+            if (stem.size() != 16 || *parsed != '\0' || fileError) continue;
+            found.push_back({time, {key, static_cast<size_t>(size)}});
+        }
+        std::sort(found.begin(), found.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (const auto& item : found) {
+            Entry& entry = entries[item.second.first];
+            entry.bytes = item.second.second;
+            totalBytes += entry.bytes;
+            touch(item.second.first, entry);
+        }
+    }
+
+    // Make the entry the most recently used
+    void touch(uint64_t key, Entry& entry) {
+        if (entry.lastUse) byUse.erase(entry.lastUse);
+        entry.lastUse = ++useCounter;
+        byUse[entry.lastUse] = key;
+    }
+
+    // Delete least recently used frames (never `keep`) until under the budget
+    void evict(uint64_t keep) {
+        size_t budget = static_cast<size_t>(std::max(budgetMB, 0)) * 1024 * 1024;
+        while (totalBytes > budget && entries.size() > 1) {
+            auto oldest = byUse.begin();
+            if (oldest->second == keep) ++oldest;
+            remove(oldest->second);
+        }
+    }
+
+    void remove(uint64_t key) {
+        auto it = entries.find(key);
+        if (it == entries.end()) return;
+        std::error_code ec;
+        std::filesystem::remove(framePath(key), ec);
+        totalBytes -= it->second.bytes;
+        byUse.erase(it->second.lastUse);
+        entries.erase(it);
+    }
+
+    std::unordered_map<uint64_t, Entry> entries;
+    std::map<uint64_t, uint64_t> byUse;  // lastUse -> key, oldest first
+    size_t totalBytes = 0;
+    uint64_t useCounter = 0;
+    bool loaded = false;
+    bool warned = false;
+    int hits = 0;
+    int misses = 0;
+};
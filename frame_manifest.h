@@ -0,0 +1,71 @@
+#pragma once
+// Per-frame content hashes of an incrementally rendered video, kept next to
+// it as `<output>.manifest`, with the encoded segments in `<output>.parts/`.
+// A later render to the same output compares each frame's hash against the
+// manifest and only re-encodes the segments that contain a changed frame;
+// the others are reused and everything is joined again without re-encoding.
+//
+// The manifest is text: a header line, the frame size, segment length and
+// encoder settings key, then one hex hash per frame.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct FrameManifest {
+    int width = 0;
+    int height = 0;
+    int segmentFrames = 0;
+    uint64_t encodeKey = 0;        // hash of the encoder command, minus the file name
+    std::vector<uint64_t> frames;  // StreamHash of each frame's rgb24 rows
+
+    // Segments from another size, segment length or encoder cannot be reused
+    bool compatible(const FrameManifest& other) const {
+        return width == other.width && height == other.height && segmentFrames == other.segmentFrames &&
+               encodeKey == other.encodeKey;
+    }
+
+    // False with an empty `error` when there is no manifest
+    bool load(const std::string& path, std::string& error) {
+        std::ifstream file(path);
+        if (!file) return false;
+        std::string magic, hex;
+        size_t count = 0;
+        if (!(file >> magic) || magic != "glslstudio-manifest-1" || !(file >> width >> height >> segmentFrames >> hex >> count)) {
+            error = "Ignoring unreadable manifest " + path;
+            return false;
+        }
+        encodeKey = strtoull(hex.c_str(), nullptr, 16);
+        frames.clear();
+        while (frames.size() < count && file >> hex) frames.push_back(strtoull(hex.c_str(), nullptr, 16));
+        if (frames.size() != count) {
+            error = "Manifest is truncated: " + path;
+            frames.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool save(const std::string& path, std::string& error) const {
+        std::ofstream file(path);
+        file << "glslstudio-manifest-1\n" << width << " " << height << " " << segmentFrames << " " << hexString(encodeKey)
+             << " " << frames.size() << "\n";
+        for (uint64_t hash : frames) file << hexString(hash) << "\n";
+        if (!file) {
+            error = "Failed to write manifest " + path;
+            return false;
+        }
+        return true;
+    }
+
+    static std::string hexString(uint64_t value) {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+        return text;
+    }
+};
+
+inline std::string manifestPath(const std::string& outputFile) { return outputFile + ".manifest"; }
+inline std::string segmentDirectory(const std::string& outputFile) { return outputFile + ".parts"; }
@@ -0,0 +1,392 @@
+#pragma once
+// Frame store: an intermediate output of the offline pipeline that keeps the
+// rendered frames so they can be encoded any number of times (other codecs,
+// CRFs or sizes) without running the shader again.
+//
+// The file is append-only and memory-mapped. A 64-byte header (format,
+// size, frame rate, frame count, index offset) is followed by one record per
+// frame: a 16-byte record header, then either the raw rgb24 rows in GL order
+// (as piped to ffmpeg) or LZ4 blocks of them. Closing the store appends the
+// frame index (record offsets) and fills in the header. A store that was
+// never closed has no index; the reader then walks the records, which are
+// only stamped once complete.
+//
+// The writer reserves the file (sparse) for the expected frames up front and
+// copies or compresses each piece straight into the mapping. Disk blocks are
+// allocated a chunk ahead of the writes, so a full disk fails the store
+// cleanly instead of raising SIGBUS on a store to the mapping. Uncompressed
+// frames are read back zero-copy from the reader's mapping.
+#include "lz4.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace frame_store {
+
+constexpr char kMagic[8] = {'G', 'S', 'F', 'R', 'M', 'S', 'T', '1'};
+constexpr uint32_t kRecordMagic = 0x52464753;  // "SGFR"
+constexpr uint32_t kCompressionNone = 0;
+constexpr uint32_t kCompressionLZ4 = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t compression;
+    float framesPerSecond;
+    uint32_t reserved;
+    uint64_t frameCount;
+    uint64_t indexOffset;  // 0 until the store is closed
+    uint8_t padding[16];
+};
+static_assert(sizeof(Header) == 64, "frame store header is 64 bytes");
+
+struct Record {
+    uint32_t magic;
+    uint32_t blocks;      // LZ4 blocks (0 when uncompressed)
+    uint64_t storedBytes; // bytes after this header
+};
+
+// Before each LZ4 block; compressedBytes == rawBytes means stored as is
+struct Block {
+    uint32_t rawBytes;
+    uint32_t compressedBytes;
+};
+
+}  // namespace frame_store
+
+class FrameStoreWriter {
+public:
+    ~FrameStoreWriter() {
+        std::string error;
+        close(error);
+    }
+
+    // Create the store for frames of width x height; `expectedFrames` and
+    // `pieceBytes` (largest write() size) size the initial reservation
+    bool open(const std::string& path, int width, int height, float framesPerSecond, bool compress,
+              int expectedFrames, size_t pieceBytes, std::string& error) {
+        close(error);
+        error.clear();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            error = "Failed to create frame store " + path;
+            return false;
+        }
+        storePath = path;
+        allocated = 0;
+        failed = false;
+        writeError.clear();
+        rawBytes = 0;
+        index.clear();
+        frameBytes = static_cast<size_t>(width) * height * 3;
+        compressed = compress;
+        size_t pieces = (frameBytes + pieceBytes - 1) / std::max<size_t>(pieceBytes, 1);
+        size_t recordBytes = sizeof(frame_store::Record) +
+            (compress ? frameBytes + frameBytes / 255 + pieces * (16 + sizeof(frame_store::Block)) : frameBytes);
+        size_t expectedBytes = sizeof(frame_store::Header) + std::max(expectedFrames, 1) * (recordBytes + sizeof(uint64_t));
+        if (!reserve(sizeof(frame_store::Header) + sizeof(frame_store::Record), error, expectedBytes)) {
+            close(error);
+            return false;
+        }
+        frame_store::Header header{};
+        memcpy(header.magic, frame_store::kMagic, sizeof(header.magic));
+        header.version = 1;
+        header.width = static_cast<uint32_t>(width);
+        header.height = static_cast<uint32_t>(height);
+        header.compression = compress ? frame_store::kCompressionLZ4 : frame_store::kCompressionNone;
+        header.framesPerSecond = framesPerSecond;
+        memcpy(map, &header, sizeof(header));
+        position = sizeof(header);
+        startRecord();
+        return true;
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    // Append the next piece of the current frame (a whole frame or a strip;
+    // pieces never span frames). Called from the encoder's writer thread.
+    bool write(const unsigned char* data, size_t bytes) {
+        if (failed || bytes > frameBytes - filled) {
+            failed = true;
+            return false;
+        }
+        if (compressed) {
+            size_t blockStart = position;
+            if (!reserve(position + sizeof(frame_store::Block) + lz4Bound(bytes), writeError)) {
+                failed = true;
+                return false;
+            }
+            frame_store::Block block{static_cast<uint32_t>(bytes), 0};
+            size_t packed = lz4Compress(data, bytes, map + blockStart + sizeof(block));
+            if (packed >= bytes) {
+                memcpy(map + blockStart + sizeof(block), data, bytes);
+                packed = bytes;
+            }
+            block.compressedBytes = static_cast<uint32_t>(packed);
+            memcpy(map + blockStart, &block, sizeof(block));
+            position = blockStart + sizeof(block) + packed;
+            blocks++;
+        } else {
+            if (!reserve(position + bytes, writeError)) {
+                failed = true;
+                return false;
+            }
+            memcpy(map + position, data, bytes);
+            position += bytes;
+        }
+        filled += bytes;
+        rawBytes += bytes;
+        if (filled == frameBytes) finishRecord();
+        return true;
+    }
+
+    // Append the index, fill in the header and trim the file. A partly
+    // written last frame is dropped.
+    bool close(std::string& error) {
+        if (fd < 0) return true;
+        bool ok = !failed;
+        if (failed) error = writeError.empty() ? "Frame store write failed: " + storePath : writeError;
+        position = recordStart;
+        size_t indexBytes = index.size() * sizeof(uint64_t);
+        if (map && reserve(position + indexBytes, error)) {
+            memcpy(map + position, index.data(), indexBytes);
+            frame_store::Header header;
+            memcpy(&header, map, sizeof(header));
+            header.frameCount = index.size();
+            header.indexOffset = position;
+            memcpy(map, &header, sizeof(header));
+            position += indexBytes;
+        } else {
+            ok = false;
+        }
+        if (map) munmap(map, mapSize);
+        map = nullptr;
+        if (ftruncate(fd, static_cast<off_t>(position)) != 0) ok = false;
+        ::close(fd);
+        fd = -1;
+        mapSize = 0;
+        return ok;
+    }
+
+    int frames() const { return static_cast<int>(index.size()); }
+    const std::string& path() const { return storePath; }
+
+    // Stored bytes per raw byte so far (1 when uncompressed)
+    double ratio() const { return rawBytes ? static_cast<double>(recordStart - sizeof(frame_store::Header)) / rawBytes : 1.0; }
+
+private:
+    // Grow the file and mapping to at least `end` bytes (doubling, or to
+    // `mapBytes`) and allocate disk blocks up to `end`
+    bool reserve(size_t end, std::string& error, size_t mapBytes = 0) {
+        if (end <= mapSize) return allocate(end, error);
+        size_t size = std::max({end, mapSize * 2, mapBytes});
+        if (map) munmap(map, mapSize);
+        map = nullptr;
+        mapSize = 0;
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            error = "Failed to reserve " + std::to_string(size >> 20) + " MB for frame store " + storePath;
+            return false;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            error = "Failed to map frame store " + storePath;
+            return false;
+        }
+        map = static_cast<unsigned char*>(mapped);
+        mapSize = size;
+        return allocate(end, error);
+    }
+
+    // Back the file with disk blocks up to at least `end`, a chunk at a time
+    bool allocate(size_t end, std::string& error) {
+        if (end <= allocated) return true;
+        size_t target = std::min(mapSize, std::max(end, allocated + kAllocateChunk));
+        int result = posix_fallocate(fd, static_cast<off_t>(allocated), static_cast<off_t>(target - allocated));
+        if (result == ENOSPC && target > end) {
+            // No room for a whole chunk; the write itself may still fit
+            target = end;
+            result = posix_fallocate(fd, static_cast<off_t>(allocated), static_cast<off_t>(target - allocated));
+        }
+        if (result == ENOSPC) {
+            error = "Disk full: frame store " + storePath + " stopped at " + std::to_string(allocated >> 20) + " MB";
+            return false;
+        }
+        // Filesystems that cannot preallocate keep the sparse behaviour
+        if (result != 0 && result != EOPNOTSUPP && result != EINVAL) {
+            error = "Failed to allocate disk space for frame store " + storePath + ": " + strerror(result);
+            return false;
+        }
+        allocated = target;
+        return true;
+    }
+
+    void startRecord() {
+        recordStart = position;
+        position += sizeof(frame_store::Record);
+        filled = 0;
+        blocks = 0;
+    }
+
+    // Stamp the record header last, so only complete frames are ever found
+    void finishRecord() {
+        if (!reserve(position + sizeof(frame_store::Record), writeError)) {
+            failed = true;
+            return;
+        }
+        frame_store::Record record{frame_store::kRecordMagic, blocks,
+                                   position - recordStart - sizeof(frame_store::Record)};
+        memcpy(map + recordStart, &record, sizeof(record));
+        index.push_back(recordStart);
+        startRecord();
+    }
+
+    static const size_t kAllocateChunk = 64u << 20;
+
+    int fd = -1;
+    unsigned char* map = nullptr;
+    size_t mapSize = 0;
+    size_t allocated = 0;  // bytes of the file backed by disk blocks
+    std::string storePath;
+    size_t frameBytes = 0;
+    bool compressed = false;
+    size_t position = 0;     // end of the data written
+    size_t recordStart = 0;  // header of the frame being written
+    size_t filled = 0;       // raw bytes of that frame so far
+    uint32_t blocks = 0;
+    size_t rawBytes = 0;
+    std::vector<uint64_t> index;
+    bool failed = false;
+    std::string writeError;
+};
+
+class FrameStoreReader {
+public:
+    ~FrameStoreReader() { close(); }
+
+    bool open(const std::string& path, std::string& error) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(frame_store::Header)) {
+            if (fd >= 0) ::close(fd);
+            error = "Cannot open frame store " + path;
+            return false;
+        }
+        mapSize = static_cast<size_t>(info.st_size);
+        void* mapped = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            mapSize = 0;
+            error = "Failed to map frame store " + path;
+            return false;
+        }
+        map = static_cast<const unsigned char*>(mapped);
+        memcpy(&header, map, sizeof(header));
+        if (memcmp(header.magic, frame_store::kMagic, sizeof(header.magic)) != 0 || header.version != 1 ||
+            header.compression > frame_store::kCompressionLZ4) {
+            close();
+            error = "Not a frame store: " + path;
+            return false;
+        }
+        if (header.indexOffset != 0 && header.indexOffset + header.frameCount * sizeof(uint64_t) <= mapSize) {
+            offsets.resize(header.frameCount);
+            memcpy(offsets.data(), map + header.indexOffset, header.frameCount * sizeof(uint64_t));
+        } else {
+            recoverIndex();
+        }
+        frame_store::Record rec;
+        for (uint64_t offset : offsets) {
+            if (!record(offset, rec)) {
+                close();
+                error = "Corrupt frame index in " + path;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        if (map) munmap(const_cast<unsigned char*>(map), mapSize);
+        map = nullptr;
+        mapSize = 0;
+        offsets.clear();
+    }
+
+    int width() const { return static_cast<int>(header.width); }
+    int height() const { return static_cast<int>(header.height); }
+    int frames() const { return static_cast<int>(offsets.size()); }
+    float framesPerSecond() const { return header.framesPerSecond; }
+    bool compressed() const { return header.compression == frame_store::kCompressionLZ4; }
+    bool finalized() const { return header.indexOffset != 0; }
+    size_t frameBytes() const { return static_cast<size_t>(header.width) * header.height * 3; }
+
+    // Pixels of an uncompressed frame, straight from the mapping
+    const unsigned char* frameData(int frame) const {
+        if (compressed()) return nullptr;
+        return map + offsets[frame] + sizeof(frame_store::Record);
+    }
+
+    // Copy or decompress a frame into `out` (frameBytes()); false if corrupt
+    bool readFrame(int frame, unsigned char* out) const {
+        frame_store::Record rec;
+        if (!record(offsets[frame], rec)) return false;
+        const unsigned char* data = map + offsets[frame] + sizeof(frame_store::Record);
+        if (!compressed()) {
+            memcpy(out, data, frameBytes());
+            return true;
+        }
+        const unsigned char* end = data + rec.storedBytes;
+        size_t written = 0;
+        for (uint32_t b = 0; b < rec.blocks; ++b) {
+            frame_store::Block block;
+            if (static_cast<size_t>(end - data) < sizeof(block)) return false;
+            memcpy(&block, data, sizeof(block));
+            data += sizeof(block);
+            if (block.compressedBytes > static_cast<size_t>(end - data) || block.rawBytes > frameBytes() - written) {
+                return false;
+            }
+            if (block.compressedBytes == block.rawBytes) {
+                memcpy(out + written, data, block.rawBytes);
+            } else if (!lz4Decompress(data, block.compressedBytes, out + written, block.rawBytes)) {
+                return false;
+            }
+            data += block.compressedBytes;
+            written += block.rawBytes;
+        }
+        return written == frameBytes();
+    }
+
+private:
+    // Record header at `offset` (records are not aligned); false if it is
+    // not a complete record
+    bool record(uint64_t offset, frame_store::Record& rec) const {
+        if (offset < sizeof(frame_store::Header) || offset + sizeof(rec) > mapSize) return false;
+        memcpy(&rec, map + offset, sizeof(rec));
+        if (rec.magic != frame_store::kRecordMagic || rec.storedBytes > mapSize - offset - sizeof(rec)) return false;
+        return compressed() || rec.storedBytes == frameBytes();
+    }
+
+    // Walk the records of a store that was not closed
+    void recoverIndex() {
+        offsets.clear();
+        frame_store::Record rec;
+        for (uint64_t offset = sizeof(frame_store::Header); record(offset, rec);
+             offset += sizeof(rec) + rec.storedBytes) {
+            offsets.push_back(offset);
+        }
+    }
+
+    const unsigned char* map = nullptr;
+    size_t mapSize = 0;
+    frame_store::Header header{};
+    std::vector<uint64_t> offsets;
+};
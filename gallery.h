@@ -0,0 +1,317 @@
+#pragma once
+// Thumbnails for the shader library browser. Each shader is drawn at a small
+// size at a few timestamps into one row of cells of a shared atlas. Only the
+// shaders the browser asks for are drawn: the atlas has a fixed number of
+// slots, reused least-recently-requested first, so its size does not depend
+// on the library size. update() works through the requests within a
+// per-call time budget so the preview keeps running while thumbnails appear.
+//
+// Thumbnails are cached on disk under the hash of the expanded shader source
+// and the thumbnail layout, as raw RGB (GL row order) so loading needs no
+// image decoder. A cache hit is a file read and a texture upload; only new or
+// changed shaders are compiled. Compile failures are cached too, so a broken
+// shader is not recompiled on every start.
+#include "hash.h"
+#include "render_target.h"
+#include "shader_utils.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+class ShaderGallery {
+public:
+    static const int kFrames = 3;
+    static constexpr float kTimes[kFrames] = {0.5f, 2.0f, 5.0f};
+
+    enum class State { Pending, Ready, Failed };
+
+    struct Thumb {
+        State state = State::Pending;
+        std::string error;
+        bool cached = false;   // loaded from disk rather than rendered
+        int slot = -1;         // atlas slot while Ready
+        uint64_t lastRequest = 0;
+    };
+
+    int cellWidth = 128;
+    int cellHeight = 72;
+    int maxSlots = 280;     // shaders held in the atlas at once
+    double budgetMs = 4.0;  // per update() call; at least one shader is processed
+    std::string cacheDir = ".glslstudio_cache/thumbnails";
+
+    // Thumbnail of a shader file ("fallback" for the built-in shader); queued
+    // for drawing if it is not in the atlas. Call for visible shaders only.
+    const Thumb& request(const std::string& path) {
+        Thumb& thumb = thumbs[path];
+        thumb.lastRequest = tick;
+        if (thumb.state == State::Pending) wanted.push_back(path);
+        return thumb;
+    }
+
+    // The file changed: draw it again (from the disk cache if the source did not)
+    void refresh(const std::string& path) {
+        auto it = thumbs.find(path);
+        if (it == thumbs.end()) return;
+        releaseSlot(it->second);
+        it->second.state = State::Pending;
+        it->second.error.clear();
+    }
+
+    // Draw this frame's pending requests until the budget is spent. Returns
+    // false if the atlas could not be allocated.
+    bool update(GLuint vao, std::string& error) {
+        bool ok = true;
+        unfinished = false;
+        if (!wanted.empty()) {
+            TRACE_ZONE("gallery");
+            auto start = std::chrono::steady_clock::now();
+            for (const std::string& path : wanted) {
+                if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs &&
+                    &path != &wanted.front()) {
+                    unfinished = true;
+                    break;
+                }
+                Thumb& thumb = thumbs[path];
+                if (thumb.state != State::Pending) continue;
+                if (!process(path, thumb, vao, error)) {
+                    ok = false;
+                    break;
+                }
+            }
+            wanted.clear();
+        }
+        tick++;
+        return ok;
+    }
+
+    // Requested thumbnails were left for the next update
+    bool busy() const { return unfinished; }
+
+    int compiledCount() const { return compiled; }
+    int cachedCount() const { return cacheHits; }
+
+    // Atlas texture and ImGui (top-left origin) UVs of one thumbnail frame
+    bool frameImage(const Thumb& thumb, int frame, GLuint& texture, float& u0, float& v0, float& u1, float& v1) const {
+        if (thumb.state != State::Ready || thumb.slot < 0) return false;
+        const RenderTarget& page = pages[thumb.slot / slotsPerPage()];
+        int x, y;
+        slotOrigin(thumb.slot, x, y);
+        x += frame * cellWidth;
+        texture = page.texture;
+        u0 = static_cast<float>(x) / page.width;
+        u1 = static_cast<float>(x + cellWidth) / page.width;
+        v0 = static_cast<float>(y + cellHeight) / page.height;
+        v1 = static_cast<float>(y) / page.height;
+        return true;
+    }
+
+    void destroy() {
+        for (auto& page : pages) page.destroy();
+        pages.clear();
+        thumbs.clear();
+        slotOwners.clear();
+        wanted.clear();
+    }
+
+private:
+    static const int kPageSize = 2048;
+    static constexpr char kMagic[8] = {'G', 'S', 'T', 'H', 'U', 'M', 'B', '1'};
+
+    int slotWidth() const { return cellWidth * kFrames; }
+    int slotsPerRow() const { return std::max(pageSize / slotWidth(), 1); }
+    int slotsPerPage() const { return slotsPerRow() * std::max(pageSize / cellHeight, 1); }
+
+    // Lower-left corner of a slot's row of cells within its page
+    void slotOrigin(int slot, int& x, int& y) const {
+        int local = slot % slotsPerPage();
+        x = (local % slotsPerRow()) * slotWidth();
+        y = (local / slotsPerRow()) * cellHeight;
+    }
+
+    // A free slot, or the least recently requested one not wanted this frame
+    int acquireSlot(const std::string& path, std::string& error) {
+        if (pages.empty()) {
+            GLint maxSize = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+            pageSize = std::min(kPageSize, static_cast<int>(maxSize));
+        }
+        int slot = -1;
+        if (static_cast<int>(slotOwners.size()) < maxSlots) {
+            slot = static_cast<int>(slotOwners.size());
+            slotOwners.push_back(path);
+        } else {
+            uint64_t oldest = tick;
+            for (int i = 0; i < static_cast<int>(slotOwners.size()); ++i) {
+                if (slotOwners[i].empty()) {
+                    slot = i;
+                    break;
+                }
+                const Thumb& owner = thumbs[slotOwners[i]];
+                if (owner.lastRequest < oldest) {
+                    oldest = owner.lastRequest;
+                    slot = i;
+                }
+            }
+            if (slot < 0) return -1;  // every slot is on screen
+            if (!slotOwners[slot].empty()) {
+                Thumb& owner = thumbs[slotOwners[slot]];
+                owner.slot = -1;
+                owner.state = State::Pending;
+            }
+            slotOwners[slot] = path;
+        }
+        if (!ensurePage(slot / slotsPerPage(), error)) return -2;
+        return slot;
+    }
+
+    void releaseSlot(Thumb& thumb) {
+        if (thumb.slot >= 0) slotOwners[thumb.slot].clear();
+        thumb.slot = -1;
+    }
+
+    // Pages are allocated on first use, only as tall as their slots need
+    bool ensurePage(int page, std::string& error) {
+        while (static_cast<int>(pages.size()) <= page) pages.emplace_back();
+        if (pages[page].valid()) return true;
+        int slots = std::min(slotsPerPage(), maxSlots - page * slotsPerPage());
+        int rows = (slots + slotsPerRow() - 1) / slotsPerRow();
+        int width = std::min(slots, slotsPerRow()) * slotWidth();
+        if (!pages[page].create(width, rows * cellHeight, GL_RGB8, "shader gallery", error)) return false;
+        glBindFramebuffer(GL_FRAMEBUFFER, pages[page].fbo);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    bool process(const std::string& path, Thumb& thumb, GLuint vao, std::string& error) {
+        std::string source;
+        if (path == "fallback") {
+            source = fallbackFragmentShaderSource;
+        } else if (!readShaderSource(path, source, thumb.error)) {
+            thumb.state = State::Failed;
+            return true;
+        }
+        std::string expanded = expandShaderSource(source);
+        ContentHash hash;
+        hash.add(expanded).addValue(cellWidth).addValue(cellHeight).add(kTimes, sizeof(kTimes));
+        std::string cachePath = cacheDir + "/" + hash.hex() + ".thumb";
+
+        std::vector<unsigned char> pixels;
+        std::string cachedError;
+        bool hit = loadCached(cachePath, pixels, cachedError);
+        if (hit && !cachedError.empty()) {
+            cacheHits++;
+            thumb.cached = true;
+            thumb.error = cachedError;
+            thumb.state = State::Failed;
+            return true;
+        }
+        GLuint program = 0;
+        if (!hit) {
+            std::string compileError;
+            compiled++;
+            if (!buildShaderProgram(expanded, program, compileError)) {
+                thumb.error = compileError;
+                thumb.state = State::Failed;
+                storeCached(cachePath, pixels, compileError);
+                return true;
+            }
+        }
+        int slot = acquireSlot(path, error);
+        if (slot < 0) {
+            if (program) glDeleteProgram(program);
+            return slot == -1;  // no slot free this frame: stay pending
+        }
+        thumb.slot = slot;
+        int x, y;
+        slotOrigin(slot, x, y);
+        const RenderTarget& page = pages[slot / slotsPerPage()];
+        if (hit) {
+            cacheHits++;
+            thumb.cached = true;
+            glBindTexture(GL_TEXTURE_2D, page.texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, slotWidth(), cellHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            thumb.state = State::Ready;
+            return true;
+        }
+
+        GLint iTimeLoc = glGetUniformLocation(program, "iTime");
+        GLint iResLoc = glGetUniformLocation(program, "iResolution");
+        GLint offsetLoc = glGetUniformLocation(program, "iTileOffset");
+        glBindFramebuffer(GL_FRAMEBUFFER, page.fbo);
+        glUseProgram(program);
+        if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(cellWidth), static_cast<float>(cellHeight), 1.0f);
+        glBindVertexArray(vao);
+        for (int frame = 0; frame < kFrames; ++frame) {
+            // Each cell sees its own pixels from (0, 0)
+            int cellX = x + frame * cellWidth;
+            glViewport(cellX, y, cellWidth, cellHeight);
+            if (offsetLoc != -1) glUniform2f(offsetLoc, static_cast<float>(-cellX), static_cast<float>(-y));
+            if (iTimeLoc != -1) glUniform1f(iTimeLoc, kTimes[frame]);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        glBindVertexArray(0);
+        pixels.resize(static_cast<size_t>(slotWidth()) * cellHeight * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(x, y, slotWidth(), cellHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteProgram(program);
+        storeCached(cachePath, pixels, "");
+        thumb.state = State::Ready;
+        return true;
+    }
+
+    // Cache file: magic, width, height, error length, error text, RGB pixels
+    bool loadCached(const std::string& path, std::vector<unsigned char>& pixels, std::string& cachedError) const {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        char magic[8];
+        int32_t header[3];
+        if (!file.read(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(magic)) != 0) return false;
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+        if (header[0] != slotWidth() || header[1] != cellHeight || header[2] < 0) return false;
+        cachedError.assign(header[2], '\0');
+        if (header[2] > 0 && !file.read(&cachedError[0], header[2])) return false;
+        if (!cachedError.empty()) return true;
+        pixels.resize(static_cast<size_t>(slotWidth()) * cellHeight * 3);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(pixels.data()), pixels.size()));
+    }
+
+    // Written to a temporary name and renamed, so a crash never leaves a torn file
+    void storeCached(const std::string& path, const std::vector<unsigned char>& pixels, const std::string& compileError) const {
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDir, ec);
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary);
+            if (!file) {
+                std::cerr << "Failed to write thumbnail cache " << temp << "\n";
+                return;
+            }
+            int32_t header[3] = {slotWidth(), cellHeight, static_cast<int32_t>(compileError.size())};
+            file.write(kMagic, sizeof(kMagic));
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file.write(compileError.data(), compileError.size());
+            file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+            if (!file) return;
+        }
+        std::filesystem::rename(temp, path, ec);
+    }
+
+    std::unordered_map<std::string, Thumb> thumbs;
+    std::vector<std::string> slotOwners;  // shader path per atlas slot ("" = free)
+    std::vector<std::string> wanted;      // pending requests of the current frame
+    std::vector<RenderTarget> pages;
+    int pageSize = kPageSize;
+    uint64_t tick = 1;
+    bool unfinished = false;
+    int compiled = 0;
+    int cacheHits = 0;
+};
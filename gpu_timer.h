@@ -0,0 +1,123 @@
+#pragma once
+// GPU timing helpers: GL_TIME_ELAPSED queries read back a few frames late
+// (so the CPU never waits on the GPU) and a rolling history with percentiles.
+#include "glad/glad.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+// Ring of GL_TIME_ELAPSED queries. A result is only read once
+// GL_QUERY_RESULT_AVAILABLE reports it is done; if every slot is still
+// in flight the next begin() skips timing that frame instead of stalling.
+// Since results arrive frames late, each query can carry a caller-defined
+// tag saying what it measured.
+class GpuTimer {
+public:
+    static const int kDefaultLatency = 5;
+
+    explicit GpuTimer(int slots = kDefaultLatency) : queries(slots, 0), tags(slots, 0), latency(slots) {}
+
+    void init() {
+        glGenQueries(latency, queries.data());
+        head = 0;
+        pending = 0;
+        active = false;
+    }
+
+    void destroy() {
+        glDeleteQueries(latency, queries.data());
+        pending = 0;
+    }
+
+    void begin(uint64_t tag = 0) {
+        active = pending < latency;
+        if (!active) return;
+        tags[head] = tag;
+        glBeginQuery(GL_TIME_ELAPSED, queries[head]);
+    }
+
+    void end() {
+        if (!active) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        head = (head + 1) % latency;
+        pending++;
+        active = false;
+    }
+
+    // Fetch the oldest finished result in milliseconds, and its begin() tag.
+    // With wait=true the oldest query is read even if it blocks (used when
+    // draining at shutdown).
+    bool poll(double& ms, bool wait = false, uint64_t* tag = nullptr) {
+        if (pending == 0) return false;
+        int slot = (head - pending + latency) % latency;
+        GLuint query = queries[slot];
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) return false;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        pending--;
+        ms = static_cast<double>(ns) / 1.0e6;
+        if (tag) *tag = tags[slot];
+        return true;
+    }
+
+private:
+    std::vector<GLuint> queries;
+    std::vector<uint64_t> tags;
+    int latency;
+    int head = 0;
+    int pending = 0;
+    bool active = false;
+};
+
+// Fixed-size rolling window of millisecond samples
+class TimingHistory {
+public:
+    explicit TimingHistory(int capacity = 240) : samples(capacity, 0.0f) {}
+
+    void add(double ms) {
+        samples[next] = static_cast<float>(ms);
+        next = (next + 1) % static_cast<int>(samples.size());
+        if (count < static_cast<int>(samples.size())) count++;
+        last = static_cast<float>(ms);
+    }
+
+    // p in [0, 1], nearest-rank over the current window
+    float percentile(float p) const {
+        if (count == 0) return 0.0f;
+        std::vector<float> sorted(ordered());
+        int rank = static_cast<int>(p * (count - 1) + 0.5f);
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+    float maxValue() const {
+        if (count == 0) return 0.0f;
+        std::vector<float> values(ordered());
+        return *std::max_element(values.begin(), values.end());
+    }
+
+    // Ring layout for ImGui::PlotHistogram(values, count, offset)
+    const float* data() const { return samples.data(); }
+    int size() const { return count; }
+    int offset() const { return count < static_cast<int>(samples.size()) ? 0 : next; }
+    float latest() const { return last; }
+
+private:
+    std::vector<float> ordered() const {
+        if (count < static_cast<int>(samples.size())) {
+            return std::vector<float>(samples.begin(), samples.begin() + count);
+        }
+        std::vector<float> values(samples.begin() + next, samples.end());
+        values.insert(values.end(), samples.begin(), samples.begin() + next);
+        return values;
+    }
+
+    std::vector<float> samples;
+    int next = 0;
+    int count = 0;
+    float last = 0.0f;
+};
@@ -0,0 +1,91 @@
+#pragma once
+// Content hashing for cache keys (FNV-1a, 64-bit) and frame contents. Not
+// cryptographic; it only has to tell changed sources, settings and frames
+// apart.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+class ContentHash {
+public:
+    ContentHash& add(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            state ^= bytes[i];
+            state *= 0x100000001b3ull;
+        }
+        return *this;
+    }
+
+    ContentHash& add(const std::string& text) {
+        // Length first, so ("ab", "c") and ("a", "bc") differ
+        uint64_t size = text.size();
+        add(&size, sizeof(size));
+        return add(text.data(), text.size());
+    }
+
+    template <typename T>
+    ContentHash& addValue(const T& value) { return add(&value, sizeof(value)); }
+
+    uint64_t value() const { return state; }
+
+    // 16 hex digits, usable as a file name
+    std::string hex() const {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(state));
+        return text;
+    }
+
+private:
+    uint64_t state = 0xcbf29ce484222325ull;
+};
+
+// Fast streaming hash for large buffers such as whole frames: four
+// multiply-rotate lanes over 8-byte words, several GB/s where FNV-1a manages
+// about one. The value does not depend on how the data is split across add()
+// calls.
+class StreamHash {
+public:
+    StreamHash& add(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        total += size;
+        if (pending > 0) {
+            size_t n = std::min(size, sizeof(tail) - pending);
+            memcpy(tail + pending, bytes, n);
+            pending += n;
+            bytes += n;
+            size -= n;
+            if (pending < sizeof(tail)) return *this;
+            block(tail);
+            pending = 0;
+        }
+        for (; size >= sizeof(tail); bytes += sizeof(tail), size -= sizeof(tail)) block(bytes);
+        memcpy(tail, bytes, size);
+        pending = size;
+        return *this;
+    }
+
+    uint64_t value() const {
+        ContentHash hash;
+        for (uint64_t lane : lanes) hash.addValue(lane);
+        return hash.add(tail, pending).addValue(total).value();
+    }
+
+private:
+    static uint64_t rotate(uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); }
+
+    void block(const unsigned char* bytes) {
+        for (int i = 0; i < 4; ++i) {
+            uint64_t word;
+            memcpy(&word, bytes + i * 8, 8);
+            lanes[i] = rotate(lanes[i] + word * 0x9e3779b97f4a7c15ull, 31) * 0xc2b2ae3d27d4eb4full;
+        }
+    }
+
+    uint64_t lanes[4] = {0x243f6a8885a308d3ull, 0x13198a2e03707344ull, 0xa4093822299f31d0ull, 0x082efa98ec4e6c89ull};
+    unsigned char tail[32];
+    size_t pending = 0;
+    uint64_t total = 0;
+};
@@ -0,0 +1,165 @@
+#pragma once
+// Per-tile shader cost profiling: the frame is drawn as a grid of scissored
+// tiles, each wrapped in its own lagged GL_TIME_ELAPSED query, giving a
+// smoothed cost map that can be overlaid on the preview or exported.
+#include "gpu_timer.h"
+#include "stb_image_write.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+class TileProfiler {
+public:
+    ~TileProfiler() { destroy(); }
+
+    // (Re)create one timer per tile; resets the accumulated costs
+    void resize(int newCols, int newRows) {
+        destroy();
+        cols = std::max(newCols, 1);
+        rows = std::max(newRows, 1);
+        timers.resize(cols * rows);
+        for (auto& timer : timers) timer.init();
+        costs.assign(cols * rows, 0.0f);
+        samples.assign(cols * rows, 0);
+    }
+
+    void destroy() {
+        for (auto& timer : timers) timer.destroy();
+        timers.clear();
+        costs.clear();
+        samples.clear();
+    }
+
+    bool active() const { return !timers.empty(); }
+    int columns() const { return cols; }
+    int rowCount() const { return rows; }
+
+    // Tile rectangle in GL window coordinates; row 0 is the top row
+    void tileRect(int col, int row, int width, int height, int& x, int& y, int& w, int& h) const {
+        int x0 = col * width / cols, x1 = (col + 1) * width / cols;
+        int top = row * height / rows, bottom = (row + 1) * height / rows;
+        x = x0;
+        w = x1 - x0;
+        y = height - bottom;
+        h = bottom - top;
+    }
+
+    // Issue draw() once per tile with the scissor set to that tile. The
+    // caller must not have another GL_TIME_ELAPSED query active.
+    template <typename DrawFn>
+    void drawTiled(int width, int height, DrawFn draw) {
+        glEnable(GL_SCISSOR_TEST);
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                int x, y, w, h;
+                tileRect(col, row, width, height, x, y, w, h);
+                glScissor(x, y, w, h);
+                GpuTimer& timer = timers[row * cols + col];
+                timer.begin();
+                draw();
+                // Submit inside the query so deferred renderers (e.g. llvmpipe)
+                // execute, and therefore time, each tile on its own
+                glFlush();
+                timer.end();
+            }
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    // Fold finished query results into the smoothed per-tile costs
+    void collect() {
+        for (size_t i = 0; i < timers.size(); ++i) {
+            double ms;
+            while (timers[i].poll(ms)) {
+                // The first draw of a tile can include lazy shader compilation
+                if (samples[i]++ == 0) continue;
+                costs[i] = costs[i] == 0.0f ? static_cast<float>(ms)
+                                            : costs[i] + kSmoothing * (static_cast<float>(ms) - costs[i]);
+            }
+        }
+    }
+
+    float cost(int col, int row) const { return costs[row * cols + col]; }
+
+    float maxCost() const {
+        float m = 0.0f;
+        for (float c : costs) m = std::max(m, c);
+        return m;
+    }
+
+    float totalCost() const {
+        float sum = 0.0f;
+        for (float c : costs) sum += c;
+        return sum;
+    }
+
+    // Cold-to-hot ramp: blue, cyan, green, yellow, red
+    static void heatColor(float t, float rgb[3]) {
+        static const float stops[5][3] = {
+            {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}
+        };
+        t = std::min(std::max(t, 0.0f), 1.0f) * 4.0f;
+        int i = std::min(static_cast<int>(t), 3);
+        float f = t - i;
+        for (int c = 0; c < 3; ++c) rgb[c] = stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f;
+    }
+
+    bool exportCsv(const std::string& path, int width, int height, std::string& error) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            error = "Failed to write heatmap CSV: " + path;
+            return false;
+        }
+        float total = totalCost();
+        file << "col,row,x,y,width,height,gpu_ms,share\n";
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                int x, y, w, h;
+                tileRect(col, row, width, height, x, y, w, h);
+                // Report x/y in image coordinates (origin top-left)
+                file << col << "," << row << "," << x << "," << height - y - h << "," << w << "," << h << ","
+                     << cost(col, row) << "," << (total > 0.0f ? cost(col, row) / total : 0.0f) << "\n";
+            }
+        }
+        return true;
+    }
+
+    // Blend the heatmap over a frame read back with glReadPixels (RGB, bottom-up)
+    bool exportPng(const std::string& path, const std::vector<unsigned char>& frame, int width, int height,
+                   float opacity, std::string& error) const {
+        std::vector<unsigned char> image(static_cast<size_t>(width) * height * 3);
+        float maxMs = std::max(maxCost(), 1e-6f);
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                int x, y, w, h;
+                tileRect(col, row, width, height, x, y, w, h);
+                float heat[3];
+                heatColor(cost(col, row) / maxMs, heat);
+                for (int py = y; py < y + h; ++py) {
+                    unsigned char* dst = &image[(static_cast<size_t>(height - 1 - py) * width + x) * 3];
+                    const unsigned char* src = &frame[(static_cast<size_t>(py) * width + x) * 3];
+                    for (int px = 0; px < w * 3; ++px) {
+                        float value = src[px] * (1.0f - opacity) + heat[px % 3] * 255.0f * opacity;
+                        // Darken tile borders so the grid stays readable
+                        if (py == y || px < 3) value *= 0.5f;
+                        dst[px] = static_cast<unsigned char>(value);
+                    }
+                }
+            }
+        }
+        if (!stbi_write_png(path.c_str(), width, height, 3, image.data(), width * 3)) {
+            error = "Failed to write heatmap image: " + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr float kSmoothing = 0.2f;
+
+    int cols = 0;
+    int rows = 0;
+    std::vector<GpuTimer> timers;
+    std::vector<float> costs;
+    std::vector<int> samples;
+};
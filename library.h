@@ -0,0 +1,422 @@
+#pragma once
+// Shader library browsing that scales to very large collections: the shader
+// directory is scanned on a background thread and entries reach the UI in
+// batches, and the fuzzy filter matches a bounded number of names per frame,
+// refining the previous matches when the query only grew. Nothing here is
+// proportional to the library size per frame.
+//
+// With an index path the scan goes through LibraryIndex: files whose time and
+// size match the index are not opened, and the filter also searches shader
+// sources through each record's trigram signature (confirming candidates
+// against the file on a background thread).
+#include "library_index.h"
+#include "shader_utils.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LibraryEntry {
+    std::string name;  // path relative to the library directory
+    std::string path;
+    ShaderRecord record;
+};
+
+class ShaderLibrary {
+public:
+    ~ShaderLibrary() { stop(); }
+
+    // Scan `directory` (recursively, .txt files) on a background thread. With
+    // `indexFile`, unchanged files are taken from the index, which is rewritten
+    // when the scan found changes.
+    void scan(const std::string& directory, const std::string& indexFile = "") {
+        stop();
+        indexPath = indexFile;
+        dirty = false;
+        complete = false;
+        items.clear();
+        lastError.clear();
+        found.clear();
+        scanError.clear();
+        done = false;
+        cancel = false;
+        running = true;
+        worker = std::thread([this, directory] { scanLoop(directory); });
+    }
+
+    // Take over the entries found since the last call; returns how many.
+    // Entries are only appended, so indices stay valid.
+    int sync() {
+        std::lock_guard<std::mutex> lock(mutex);
+        int added = static_cast<int>(found.size());
+        for (auto& entry : found) items.push_back(std::move(entry));
+        found.clear();
+        if (done && running) {
+            running = false;
+            complete = !cancel;
+            lastError = scanError;
+        }
+        return added;
+    }
+
+    bool scanning() const { return running; }
+    const std::vector<LibraryEntry>& entries() const { return items; }
+    const std::string& error() const { return lastError; }
+
+    void stop() {
+        cancel = true;
+        if (worker.joinable()) worker.join();
+        running = false;
+    }
+
+    // Metadata learned while the library is in use; kept in the index
+    void setCompileResult(int index, bool ok, const std::string& error) {
+        ShaderRecord& record = items[index].record;
+        CompileStatus status = ok ? CompileStatus::Ok : CompileStatus::Failed;
+        if (record.compile == status && record.compileError == error) return;
+        record.compile = status;
+        record.compileError = error;
+        dirty = true;
+    }
+
+    void recordCost(int index, int width, int height, float ms) {
+        items[index].record.recordCost(width, height, ms);
+        dirty = true;
+    }
+
+    // Write the index if anything changed since the scan. Only a complete scan
+    // is saved, so files not reached yet are not dropped from the index.
+    bool save(std::string& error) {
+        if (!dirty || !complete || indexPath.empty()) return true;
+        if (!LibraryIndex::save(indexPath, items, error)) return false;
+        dirty = false;
+        return true;
+    }
+
+private:
+    static const size_t kBatch = 256;
+
+    void scanLoop(std::string directory) {
+        trace::setThreadName("library scan");
+        TRACE_ZONE("library scan");
+        namespace fs = std::filesystem;
+        std::vector<LibraryEntry> batch;
+        std::string error;
+        size_t total = 0;
+        std::string indexError;
+        std::unordered_map<std::string, ShaderRecord> index;
+        if (!indexPath.empty()) index = LibraryIndex::load(indexPath, indexError);
+        if (!indexError.empty()) std::cerr << indexError << std::endl;
+        std::vector<LibraryEntry> indexed;  // everything found, for rewriting the index
+        size_t reused = 0;
+        try {
+            if (!fs::exists(directory)) {
+                error = "Shader directory does not exist: " + directory;
+            } else {
+                for (fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied), end;
+                     it != end && !cancel; ++it) {
+                    if (!it->is_regular_file()) continue;
+                    std::string ext = it->path().extension().string();
+                    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+                    if (ext != ".txt") continue;
+                    LibraryEntry entry;
+                    entry.name = it->path().lexically_relative(directory).generic_string();
+                    entry.path = it->path().string();
+                    if (!indexPath.empty()) {
+                        if (describe(*it, index, entry.record)) reused++;
+                        indexed.push_back(entry);
+                    }
+                    batch.push_back(std::move(entry));
+                    if (batch.size() >= kBatch) {
+                        total += batch.size();
+                        publish(batch);
+                    }
+                }
+                total += batch.size();
+                if (total == 0) error = "No .txt shader files found in directory: " + directory;
+            }
+        } catch (const std::exception& e) {
+            error = "Error reading shader directory: " + std::string(e.what());
+        }
+        publish(batch);
+        if (!indexPath.empty() && !cancel && (reused != indexed.size() || index.size() != indexed.size())) {
+            std::string saveError;
+            if (!LibraryIndex::save(indexPath, indexed, saveError)) std::cerr << saveError << std::endl;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        scanError = error;
+        done = true;
+    }
+
+    // Fill the record of one file: from the index when its time and size are
+    // unchanged (returns true), otherwise by reading it. Compile results and
+    // costs survive a touch that left the content as it was.
+    static bool describe(const std::filesystem::directory_entry& file,
+                         const std::unordered_map<std::string, ShaderRecord>& index, ShaderRecord& record) {
+        std::error_code ec;
+        int64_t mtime = static_cast<int64_t>(file.last_write_time(ec).time_since_epoch().count());
+        uint64_t size = file.file_size(ec);
+        auto known = index.find(file.path().string());
+        if (known != index.end() && known->second.mtime == mtime && known->second.size == size) {
+            record = known->second;
+            return true;
+        }
+        std::string source, error;
+        readShaderSource(file.path().string(), source, error);
+        analyzeShaderSource(source, record);
+        if (known != index.end() && known->second.hash == record.hash) {
+            record.compile = known->second.compile;
+            record.compileError = known->second.compileError;
+            record.costs = known->second.costs;
+        }
+        record.mtime = mtime;
+        record.size = size;
+        return false;
+    }
+
+    void publish(std::vector<LibraryEntry>& batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : batch) found.push_back(std::move(entry));
+        batch.clear();
+    }
+
+    std::thread worker;
+    std::atomic<bool> cancel{false};
+    bool running = false;  // main thread only
+    std::mutex mutex;
+    std::vector<LibraryEntry> found;  // guarded by mutex
+    std::string scanError;            // guarded by mutex
+    bool done = false;                // guarded by mutex
+    std::string indexPath;            // read by the worker, set before it starts
+    std::vector<LibraryEntry> items;
+    std::string lastError;
+    bool complete = false;            // the last scan reached every file
+    bool dirty = false;
+};
+
+// Case-insensitive subsequence match: every query character must appear in
+// `text` in order. Higher is better; consecutive characters and matches at
+// the start of a word score extra. Returns -1 when there is no match.
+inline int fuzzyScore(const std::string& query, const std::string& text) {
+    int score = 0;
+    size_t t = 0;
+    bool previousMatched = false;
+    for (char qc : query) {
+        char q = static_cast<char>(std::tolower(static_cast<unsigned char>(qc)));
+        bool matched = false;
+        for (; t < text.size(); ++t) {
+            if (static_cast<char>(std::tolower(static_cast<unsigned char>(text[t]))) != q) {
+                previousMatched = false;
+                continue;
+            }
+            score += 1;
+            if (previousMatched) score += 4;
+            if (t == 0 || !std::isalnum(static_cast<unsigned char>(text[t - 1]))) score += 3;
+            previousMatched = true;
+            matched = true;
+            ++t;
+            break;
+        }
+        if (!matched) return -1;
+    }
+    return score;
+}
+
+// Incremental fuzzy filter over a growing entry list. update() matches at
+// most `chunk` names per call; when the query extends the previous one only
+// the previous matches are re-checked. Results are ranked by score once a
+// pass completes (in library order until then). Queries of three or more
+// characters also match shader sources: the record's trigram signature picks
+// candidates, and a background thread confirms each by reading the source.
+// The pass stays pending until every candidate is answered. Such matches rank
+// below name matches.
+class ShaderFilter {
+public:
+    int chunk = 4096;
+
+    ~ShaderFilter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    void setQuery(const std::string& text) {
+        if (text == query) return;
+        // A longer query matches a subset of the shorter one's matches, unless
+        // it just became long enough to search sources
+        bool refine = !query.empty() && text.compare(0, query.size(), query) == 0 && !refining && cursor == covered &&
+                      unanswered == 0 && (query.size() >= 3 || text.size() < 3);
+        {
+            // Answers for the old query are dropped when they arrive
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.clear();
+            generation++;
+        }
+        unanswered = 0;
+        query = text;
+        if (refine) {
+            previous.swap(results);
+            refining = true;
+        } else {
+            previous.clear();
+            covered = 0;
+            refining = false;
+        }
+        results.clear();
+        cursor = 0;
+    }
+
+    // Continue the current pass; also picks up entries appended since
+    void update(const std::vector<LibraryEntry>& entries) {
+        if (query.empty()) return;
+        TRACE_ZONE("filter");
+        int budget = chunk;
+        bool added = collectAnswers();
+        while (refining && budget > 0) {
+            if (cursor >= previous.size()) {
+                refining = false;
+                previous.clear();
+                cursor = covered;
+                break;
+            }
+            test(entries, previous[cursor++].index);
+            budget--;
+            added = true;
+        }
+        if (!refining) {
+            cursor = std::max(cursor, covered);
+            while (budget > 0 && cursor < entries.size()) {
+                test(entries, static_cast<int>(cursor++));
+                budget--;
+                added = true;
+            }
+            covered = cursor;
+        }
+        if (added && !pending(entries)) {
+            std::stable_sort(results.begin(), results.end(),
+                             [](const Match& a, const Match& b) { return a.score > b.score; });
+        }
+    }
+
+    bool pending(const std::vector<LibraryEntry>& entries) const {
+        return !query.empty() && (refining || covered < entries.size() || unanswered > 0);
+    }
+
+    // Matching entries (every entry when the query is empty)
+    int count(const std::vector<LibraryEntry>& entries) const {
+        return query.empty() ? static_cast<int>(entries.size()) : static_cast<int>(results.size());
+    }
+
+    int at(int i) const { return query.empty() ? i : results[i].index; }
+
+private:
+    struct Match {
+        int index;
+        int score;
+    };
+
+    struct Request {
+        int generation;
+        int index;
+        std::string path;
+        std::string query;
+    };
+
+    struct Answer {
+        int generation;
+        int index;
+        bool match;
+    };
+
+    // Match one entry's name; a source candidate is handed to the confirm thread
+    void test(const std::vector<LibraryEntry>& entries, int index) {
+        int score = fuzzyScore(query, entries[index].name);
+        if (score >= 0) {
+            results.push_back(Match{index, score});
+        } else if (signatureContains(entries[index].record.signature, query)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                requests.push_back(Request{generation, index, entries[index].path, query});
+                if (!worker.joinable()) worker = std::thread([this] { confirmLoop(); });
+            }
+            wake.notify_one();
+            unanswered++;
+        }
+    }
+
+    // Take over the confirm thread's answers for the current query; true if any
+    bool collectAnswers() {
+        std::vector<Answer> taken;
+        int current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            taken.swap(answers);
+            current = generation;
+        }
+        bool any = false;
+        for (const Answer& answer : taken) {
+            if (answer.generation != current) continue;
+            unanswered--;
+            any = true;
+            if (answer.match) results.push_back(Match{answer.index, 0});
+        }
+        return any;
+    }
+
+    void confirmLoop() {
+        trace::setThreadName("library filter");
+        for (;;) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !requests.empty(); });
+                if (stopping) return;
+                request = std::move(requests.front());
+                requests.pop_front();
+            }
+            bool match;
+            {
+                TRACE_ZONE("confirm source match");
+                match = sourceContains(request.path, request.query);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            answers.push_back(Answer{request.generation, request.index, match});
+        }
+    }
+
+    // Case-insensitive search of the shader file (signatures can report false matches)
+    static bool sourceContains(const std::string& path, const std::string& text) {
+        std::string source, error;
+        if (!readShaderSource(path, source, error)) return false;
+        auto equal = [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        };
+        return std::search(source.begin(), source.end(), text.begin(), text.end(), equal) != source.end();
+    }
+
+    std::string query;
+    std::vector<Match> results;
+    std::vector<Match> previous;  // matches of the shorter query being refined
+    size_t cursor = 0;            // next position in previous (refining) or entries
+    size_t covered = 0;           // entries [0, covered) are accounted for in results
+    bool refining = false;
+    int unanswered = 0;           // candidates of this query still being confirmed
+    // Confirm thread, started with the first source candidate
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Request> requests;  // guarded by mutex
+    std::vector<Answer> answers;   // guarded by mutex
+    int generation = 0;            // guarded by mutex; bumped by every query change
+    bool stopping = false;         // guarded by mutex
+};
@@ -0,0 +1,283 @@
+#pragma once
+// Persistent index of the shader library: per shader file, its modification
+// time, size, content hash, the uniforms it declares and uses, the last
+// compile result, measured GPU cost per resolution and a trigram signature
+// of the source for full-text search. The signature is a two-bit-per-trigram
+// Bloom filter sized to the source's distinct trigrams, which keeps false
+// positives to a few percent for a single trigram and far fewer for longer
+// queries. A library scan only opens files whose
+// time or size changed since the index was written; everything else comes
+// from the one index file.
+//
+// The file is binary: a magic/version header, a record count, then one
+// record per shader (strings are length-prefixed).
+#include "hash.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class CompileStatus : uint8_t { Unknown, Ok, Failed };
+
+struct ShaderCost {
+    int32_t width = 0;
+    int32_t height = 0;
+    float ms = 0.0f;  // GPU time of one frame at that resolution
+};
+
+struct ShaderRecord {
+    static const int kSignatureBitsPerTrigram = 12;
+    static constexpr size_t kMinSignatureBytes = 64;
+    static constexpr size_t kMaxSignatureBytes = 64 * 1024;
+    static const int kMaxCosts = 8;
+
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    bool usesTime = false;
+    bool usesResolution = false;
+    std::vector<std::string> uniforms;  // declared and referenced, built-ins excluded
+    CompileStatus compile = CompileStatus::Unknown;
+    std::string compileError;
+    std::vector<ShaderCost> costs;
+    std::vector<uint8_t> signature;  // trigram Bloom filter, see analyzeShaderSource()
+
+    // Blend a new measurement into the cost at that resolution; the oldest
+    // resolution is dropped once kMaxCosts are stored
+    void recordCost(int width, int height, float ms) {
+        for (auto& cost : costs) {
+            if (cost.width == width && cost.height == height) {
+                cost.ms = cost.ms * 0.75f + ms * 0.25f;
+                return;
+            }
+        }
+        if (static_cast<int>(costs.size()) >= kMaxCosts) costs.erase(costs.begin());
+        costs.push_back(ShaderCost{width, height, ms});
+    }
+};
+
+// Key of a lower-cased trigram
+inline uint32_t trigramKey(unsigned char a, unsigned char b, unsigned char c) {
+    return (static_cast<uint32_t>(std::tolower(a)) << 16) | (static_cast<uint32_t>(std::tolower(b)) << 8) |
+           static_cast<uint32_t>(std::tolower(c));
+}
+
+// The two bits of a trigram in a signature of `bits` bits
+inline void trigramBits(uint32_t key, size_t bits, size_t& first, size_t& second) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 29;
+    first = static_cast<size_t>(((h >> 32) * bits) >> 32);
+    second = static_cast<size_t>(((h & 0xFFFFFFFFull) * bits) >> 32);
+}
+
+inline bool signatureBit(const std::vector<uint8_t>& signature, size_t bit) {
+    return (signature[bit >> 3] & (1u << (bit & 7))) != 0;
+}
+
+// True when every trigram of `query` (3+ characters) is set in the signature.
+// May report false positives, never false negatives.
+inline bool signatureContains(const std::vector<uint8_t>& signature, const std::string& query) {
+    if (query.size() < 3 || signature.empty()) return false;
+    size_t bits = signature.size() * 8;
+    for (size_t i = 0; i + 2 < query.size(); ++i) {
+        size_t first, second;
+        trigramBits(trigramKey(query[i], query[i + 1], query[i + 2]), bits, first, second);
+        if (!signatureBit(signature, first) || !signatureBit(signature, second)) return false;
+    }
+    return true;
+}
+
+// Hash, uniforms and trigram signature of a shader source
+inline void analyzeShaderSource(const std::string& source, ShaderRecord& record) {
+    record.hash = ContentHash().add(source).value();
+    std::unordered_set<uint32_t> trigrams;
+    for (size_t i = 0; i + 2 < source.size(); ++i) trigrams.insert(trigramKey(source[i], source[i + 1], source[i + 2]));
+    size_t bytes = (trigrams.size() * ShaderRecord::kSignatureBitsPerTrigram + 63) / 64 * 8;
+    bytes = std::min(std::max(bytes, ShaderRecord::kMinSignatureBytes), ShaderRecord::kMaxSignatureBytes);
+    record.signature.assign(bytes, 0);
+    for (uint32_t key : trigrams) {
+        size_t first, second;
+        trigramBits(key, bytes * 8, first, second);
+        record.signature[first >> 3] |= static_cast<uint8_t>(1u << (first & 7));
+        record.signature[second >> 3] |= static_cast<uint8_t>(1u << (second & 7));
+    }
+
+    // Identifier counts; a uniform is referenced if it appears beyond its
+    // declaration. Declarations are `uniform [precision] type name[, name];`
+    enum { Code, Type, Name, AfterName } state = Code;
+    std::unordered_map<std::string, int> counts;
+    std::vector<std::string> declared;
+    for (size_t i = 0; i < source.size();) {
+        unsigned char c = source[i];
+        if (c == '/' && i + 1 < source.size() && source[i + 1] == '/') {
+            while (i < source.size() && source[i] != '\n') ++i;
+            continue;
+        }
+        if (c == '/' && i + 1 < source.size() && source[i + 1] == '*') {
+            size_t end = source.find("*/", i + 2);
+            i = end == std::string::npos ? source.size() : end + 2;
+            continue;
+        }
+        if (!std::isalpha(c) && c != '_') {
+            if (c == ';') state = Code;
+            else if (c == ',' && state == AfterName) state = Name;
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_')) ++i;
+        std::string word = source.substr(start, i - start);
+        counts[word]++;
+        if (state == Code && word == "uniform") {
+            state = Type;
+        } else if (state == Type && word != "lowp" && word != "mediump" && word != "highp") {
+            state = Name;
+        } else if (state == Name) {
+            declared.push_back(word);
+            state = AfterName;
+        }
+    }
+    auto declaredOnce = [&](const char* name) {
+        return std::find(declared.begin(), declared.end(), name) != declared.end() ? 1 : 0;
+    };
+    record.usesTime = counts["iTime"] > declaredOnce("iTime");
+    record.usesResolution = counts["iResolution"] > declaredOnce("iResolution");
+    record.uniforms.clear();
+    for (const auto& name : declared) {
+        if (name == "iTime" || name == "iResolution" || name == "iTileOffset") continue;
+        if (counts[name] > 1) record.uniforms.push_back(name);
+    }
+}
+
+class LibraryIndex {
+public:
+    static constexpr char kMagic[8] = {'G', 'S', 'L', 'I', 'B', 'I', 'X', '2'};
+
+    // Records by file path; a missing or unreadable file is an empty index
+    static std::unordered_map<std::string, ShaderRecord> load(const std::string& path, std::string& error) {
+        std::unordered_map<std::string, ShaderRecord> records;
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return records;
+        char magic[8];
+        uint32_t count = 0;
+        if (!file.read(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(magic)) != 0 || !readValue(file, count)) {
+            error = "Ignoring library index with unknown format: " + path;
+            return records;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string shaderPath;
+            ShaderRecord record;
+            if (!readRecord(file, shaderPath, record)) {
+                error = "Library index is truncated: " + path;
+                records.clear();
+                return records;
+            }
+            records[shaderPath] = std::move(record);
+        }
+        return records;
+    }
+
+    // Write to a temporary file and rename it over the index
+    template <typename Entries>
+    static bool save(const std::string& path, const Entries& entries, std::string& error) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary);
+            if (!file) {
+                error = "Failed to write library index " + temp;
+                return false;
+            }
+            file.write(kMagic, sizeof(kMagic));
+            writeValue(file, static_cast<uint32_t>(entries.size()));
+            for (const auto& entry : entries) writeRecord(file, entry.path, entry.record);
+            if (!file) {
+                error = "Failed to write library index " + temp;
+                return false;
+            }
+        }
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            error = "Failed to replace library index " + path + ": " + ec.message();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    template <typename T>
+    static void writeValue(std::ofstream& file, const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static bool readValue(std::ifstream& file, T& value) {
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    static void writeString(std::ofstream& file, const std::string& text) {
+        writeValue(file, static_cast<uint32_t>(text.size()));
+        file.write(text.data(), text.size());
+    }
+
+    static bool readString(std::ifstream& file, std::string& text) {
+        uint32_t size = 0;
+        if (!readValue(file, size) || size > (1u << 24)) return false;
+        text.resize(size);
+        return size == 0 || static_cast<bool>(file.read(&text[0], size));
+    }
+
+    static void writeRecord(std::ofstream& file, const std::string& path, const ShaderRecord& record) {
+        writeString(file, path);
+        writeValue(file, record.mtime);
+        writeValue(file, record.size);
+        writeValue(file, record.hash);
+        uint8_t flags = (record.usesTime ? 1 : 0) | (record.usesResolution ? 2 : 0);
+        writeValue(file, flags);
+        writeValue(file, static_cast<uint8_t>(record.compile));
+        writeString(file, record.compileError);
+        writeValue(file, static_cast<uint16_t>(record.uniforms.size()));
+        for (const auto& name : record.uniforms) writeString(file, name);
+        writeValue(file, static_cast<uint8_t>(record.costs.size()));
+        for (const auto& cost : record.costs) writeValue(file, cost);
+        writeValue(file, static_cast<uint32_t>(record.signature.size()));
+        file.write(reinterpret_cast<const char*>(record.signature.data()), record.signature.size());
+    }
+
+    static bool readRecord(std::ifstream& file, std::string& path, ShaderRecord& record) {
+        uint8_t flags = 0, compile = 0, costCount = 0;
+        uint16_t uniformCount = 0;
+        if (!readString(file, path) || !readValue(file, record.mtime) || !readValue(file, record.size) ||
+            !readValue(file, record.hash) || !readValue(file, flags) || !readValue(file, compile) ||
+            !readString(file, record.compileError) || !readValue(file, uniformCount)) {
+            return false;
+        }
+        record.usesTime = flags & 1;
+        record.usesResolution = flags & 2;
+        record.compile = compile <= static_cast<uint8_t>(CompileStatus::Failed) ? static_cast<CompileStatus>(compile)
+                                                                               : CompileStatus::Unknown;
+        record.uniforms.resize(uniformCount);
+        for (auto& name : record.uniforms) {
+            if (!readString(file, name)) return false;
+        }
+        if (!readValue(file, costCount) || costCount > ShaderRecord::kMaxCosts) return false;
+        record.costs.resize(costCount);
+        for (auto& cost : record.costs) {
+            if (!readValue(file, cost)) return false;
+        }
+        uint32_t signatureBytes = 0;
+        if (!readValue(file, signatureBytes) || signatureBytes > ShaderRecord::kMaxSignatureBytes) return false;
+        record.signature.resize(signatureBytes);
+        return signatureBytes == 0 ||
+               static_cast<bool>(file.read(reinterpret_cast<char*>(record.signature.data()), signatureBytes));
+    }
+};
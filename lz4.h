@@ -0,0 +1,124 @@
+#pragma once
+// LZ4 block format (compatible with the reference lz4 library's
+// LZ4_compress_default / LZ4_decompress_safe), small enough to carry here
+// instead of a dependency. The compressor is the plain greedy single-hash
+// variant: a few hundred MB/s, good ratios on flat or repetitive shader
+// output, and it quickly skips ahead over data that does not compress.
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Largest compressed size of `size` input bytes
+inline size_t lz4Bound(size_t size) { return size + size / 255 + 16; }
+
+// Compress `size` bytes into `out` (at least lz4Bound(size) bytes); returns
+// the compressed size
+inline size_t lz4Compress(const unsigned char* in, size_t size, unsigned char* out) {
+    const size_t kMinMatch = 4, kLastLiterals = 5, kMatchLimit = 12;  // format rules
+    const int kHashBits = 16;
+    std::vector<uint32_t> table(size_t(1) << kHashBits, 0);  // position + 1 of the last occurrence
+    auto read32 = [&](size_t i) {
+        uint32_t value;
+        memcpy(&value, in + i, 4);
+        return value;
+    };
+    auto hash = [&](uint32_t value) { return (value * 2654435761u) >> (32 - kHashBits); };
+    auto putLength = [&](unsigned char*& op, size_t length) {
+        for (; length >= 255; length -= 255) *op++ = 255;
+        *op++ = static_cast<unsigned char>(length);
+    };
+    auto putSequence = [&](unsigned char*& op, size_t literalStart, size_t literals, size_t offset, size_t match) {
+        unsigned char* token = op++;
+        *token = static_cast<unsigned char>((literals >= 15 ? 15 : literals) << 4);
+        if (literals >= 15) putLength(op, literals - 15);
+        memcpy(op, in + literalStart, literals);
+        op += literals;
+        if (offset == 0) return;  // last sequence: literals only
+        *op++ = static_cast<unsigned char>(offset & 0xff);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+        size_t extra = match - kMinMatch;
+        *token |= static_cast<unsigned char>(extra >= 15 ? 15 : extra);
+        if (extra >= 15) putLength(op, extra - 15);
+    };
+
+    unsigned char* op = out;
+    size_t anchor = 0;
+    if (size > kMatchLimit) {
+        size_t i = 0, misses = 0;
+        while (i + kMatchLimit < size) {
+            uint32_t sequence = read32(i);
+            uint32_t& slot = table[hash(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(i + 1);
+            if (candidate == 0 || i + 1 - candidate > 65535 || read32(candidate - 1) != sequence) {
+                i += 1 + (misses++ >> 6);  // skip faster through incompressible data
+                continue;
+            }
+            size_t ref = candidate - 1;
+            size_t match = kMinMatch;
+            while (i + match < size - kLastLiterals && in[ref + match] == in[i + match]) ++match;
+            // Extend backwards over literals that also match
+            while (i > anchor && ref > 0 && in[i - 1] == in[ref - 1]) {
+                --i;
+                --ref;
+                ++match;
+            }
+            putSequence(op, anchor, i - anchor, i - ref, match);
+            i += match;
+            anchor = i;
+            misses = 0;
+        }
+    }
+    putSequence(op, anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(op - out);
+}
+
+// Decompress a block into exactly `outSize` bytes; false if it is malformed
+inline bool lz4Decompress(const unsigned char* in, size_t size, unsigned char* out, size_t outSize) {
+    const unsigned char* ip = in;
+    const unsigned char* end = in + size;
+    unsigned char* op = out;
+    unsigned char* outEnd = out + outSize;
+    auto getLength = [&](size_t& length) {
+        unsigned char byte;
+        do {
+            if (ip >= end) return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+    while (ip < end) {
+        unsigned char token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !getLength(literals)) return false;
+        if (literals > static_cast<size_t>(end - ip) || literals > static_cast<size_t>(outEnd - op)) return false;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == end) break;  // the last sequence has no match
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - out)) return false;
+        size_t match = token & 15;
+        if (match == 15 && !getLength(match)) return false;
+        match += 4;
+        if (match > static_cast<size_t>(outEnd - op)) return false;
+        const unsigned char* from = op - offset;
+        if (offset >= match) {
+            memcpy(op, from, match);
+            op += match;
+        } else {
+            // Overlapping run: repeat the period in doubling, non-overlapping copies
+            for (size_t k = 0, step = offset; k < match; step = k + offset) {
+                size_t n = std::min(step, match - k);
+                memcpy(op + k, op + k - step, n);
+                k += n;
+            }
+            op += match;
+        }
+    }
+    return op == outEnd;
+}
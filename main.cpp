@@ -1,8 +1,26 @@
+// stb_image_write's implementation is compiled here, ahead of the project
+// headers that include stb_image_write.h. Its implementation section is not
+// covered by the include guard, so the define must not reach those includes.
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#undef STB_IMAGE_WRITE_IMPLEMENTATION
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
+#include "gpu_timer.h"
+#include "trace.h"
+#include "shader_utils.h"
+#include "encoder.h"
+#include "progress.h"
+#include "offline_render.h"
+#include "preview.h"
+#include "offline_jobs.h"
+#include "gallery.h"
+#include "library.h"
+#include "timeline.h"
+#include "heatmap.h"
 #include <iostream>
 #include <vector>
 #include <fstream>
@@ -10,136 +28,366 @@
 #include <filesystem>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
 
 namespace fs = std::filesystem;
 
-// Default window dimensions (4K)
-int WIN_WIDTH = 3840;
-int WIN_HEIGHT = 2160;
+// Initial window dimensions (the window is resizable; the preview resolution
+// is chosen separately)
+int WIN_WIDTH = 1920;
+int WIN_HEIGHT = 1080;
 int OFF_WIDTH = 3840;
 int OFF_HEIGHT = 2160;
 
-// Vertex shader
-const char* vertexShaderSource = R"(
-#version 330 core
-layout(location = 0) in vec3 aPosition;
-layout(location = 1) in vec2 aTexCoord;
-out vec2 fragUV;
-void main()
-{
-    gl_Position = vec4(aPosition, 1.0);
-    fragUV = aTexCoord;
-}
-)";
-
-// Fallback fragment shader (solid red for debugging)
-const char* fallbackFragmentShaderSource = R"(
-#version 330 core
-out vec4 FragColor;
-void main()
-{
-    FragColor = vec4(1.0, 0.0, 0.0, 1.0); // Red color
+// Output path that does not overwrite an existing file (base.ext, base_1.ext, ...)
+// or one a queued render job is going to write
+std::string uniqueOutputPath(const std::string& baseName, const std::string& extension,
+                             const OfflineJobQueue* jobs = nullptr) {
+    std::string path = baseName + extension;
+    int counter = 1;
+    while (fs::exists(path) || (jobs && jobs->claims(path))) {
+        std::ostringstream oss;
+        oss << baseName << "_" << counter << extension;
+        path = oss.str();
+        counter++;
+    }
+    return path;
 }
-)";
-
-// Compile shader with error checking
-bool compileShader(GLenum type, const char* source, GLuint& shader, std::string& error) {
-    shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        error = "Shader compilation failed (" +
-                std::string(type == GL_VERTEX_SHADER ? "vertex" : "fragment") +
-                "):\n" + infoLog;
-        glDeleteShader(shader);
-        return false;
+
+// Tint each profiled tile of the preview by its share of the slowest tile.
+// The preview image is imageWidth x imageHeight, shown letterboxed in a
+// windowWidth x windowHeight framebuffer.
+void drawHeatmapOverlay(const TileProfiler& profiler, int imageWidth, int imageHeight, int windowWidth, int windowHeight,
+                        float opacity) {
+    ImDrawList* drawList = ImGui::GetBackgroundDrawList();
+    ImVec2 display = ImGui::GetIO().DisplaySize;
+    int rx, ry, rw, rh;
+    fitPreviewRect(imageWidth, imageHeight, windowWidth, windowHeight, rx, ry, rw, rh);
+    // Image pixels -> display coordinates (top-left origin)
+    float sx = display.x / windowWidth * rw / imageWidth, sy = display.y / windowHeight * rh / imageHeight;
+    float ox = display.x / windowWidth * rx, oy = display.y / windowHeight * (windowHeight - ry - rh);
+    float maxMs = std::max(profiler.maxCost(), 1e-6f);
+    for (int row = 0; row < profiler.rowCount(); ++row) {
+        for (int col = 0; col < profiler.columns(); ++col) {
+            int x, y, w, h;
+            profiler.tileRect(col, row, imageWidth, imageHeight, x, y, w, h);
+            float heat[3];
+            TileProfiler::heatColor(profiler.cost(col, row) / maxMs, heat);
+            ImVec2 p0(ox + x * sx, oy + (imageHeight - y - h) * sy), p1(ox + (x + w) * sx, oy + (imageHeight - y) * sy);
+            drawList->AddRectFilled(p0, p1, ImGui::GetColorU32(ImVec4(heat[0], heat[1], heat[2], opacity)));
+            drawList->AddRect(p0, p1, IM_COL32(0, 0, 0, 96));
+            char label[16];
+            snprintf(label, sizeof(label), "%.2f", profiler.cost(col, row));
+            drawList->AddText(ImVec2(p0.x + 3, p0.y + 2), IM_COL32(255, 255, 255, 220), label);
+        }
     }
-    return true;
 }
 
-// Link program with error checking
-bool linkProgram(GLuint vertShader, GLuint fragShader, GLuint& program, std::string& error) {
-    program = glCreateProgram();
-    glAttachShader(program, vertShader);
-    glAttachShader(program, fragShader);
-    glLinkProgram(program);
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        error = "Program linking failed:\n" + std::string(infoLog);
-        glDeleteProgram(program);
-        return false;
+// Live memory totals and the largest tracked allocations
+void showResourcePanel(int& gpuBudgetMB, int& hostBudgetMB, bool& downscaleOverBudget) {
+    ResourceRegistry& registry = ResourceRegistry::instance();
+    ImGui::Text("GPU: %.1f MB (peak %.1f) / budget %d MB", ResourceRegistry::toMB(registry.gpuBytes()),
+                ResourceRegistry::toMB(registry.gpuPeak()), gpuBudgetMB);
+    ImGui::Text("Host: %.1f MB (peak %.1f) / budget %d MB", ResourceRegistry::toMB(registry.hostBytes()),
+                ResourceRegistry::toMB(registry.hostPeak()), hostBudgetMB);
+    if (ImGui::InputInt("GPU Budget (MB)", &gpuBudgetMB, 256)) {
+        gpuBudgetMB = std::max(gpuBudgetMB, 0);
+        registry.gpuBudget = static_cast<size_t>(gpuBudgetMB) * 1024 * 1024;
     }
-    glValidateProgram(program);
-    glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        error = "Program validation failed:\n" + std::string(infoLog);
-        glDeleteProgram(program);
-        return false;
+    if (ImGui::InputInt("Host Budget (MB)", &hostBudgetMB, 256)) {
+        hostBudgetMB = std::max(hostBudgetMB, 0);
+        registry.hostBudget = static_cast<size_t>(hostBudgetMB) * 1024 * 1024;
+    }
+    ImGui::Checkbox("Downscale jobs over budget", &downscaleOverBudget);
+    if (ImGui::TreeNode("Allocations")) {
+        for (const auto& entry : registry.snapshot()) {
+            ImGui::Text("%-11s %8.2f MB  %s: %s", resourceKindName(entry.kind), ResourceRegistry::toMB(entry.bytes),
+                        entry.owner.c_str(), entry.label.c_str());
+        }
+        ImGui::TreePop();
     }
-    return true;
 }
 
-// Load shader from file
-std::string loadShaderFile(const std::string& filepath, std::string& error) {
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        error = "Failed to open shader file: " + filepath;
-        std::cerr << error << "\n";
-        return "";
+// Tooltip with what the library index knows about a shader
+void showShaderRecord(const LibraryEntry& entry) {
+    const ShaderRecord& record = entry.record;
+    ImGui::BeginTooltip();
+    ImGui::TextUnformatted(entry.name.c_str());
+    ImGui::Text("%.1f KB, uses %s%s%s", record.size / 1024.0, record.usesTime ? "iTime " : "",
+                record.usesResolution ? "iResolution " : "", record.usesTime || record.usesResolution ? "" : "no built-ins");
+    if (!record.uniforms.empty()) {
+        std::string names;
+        for (const auto& name : record.uniforms) names += (names.empty() ? "" : ", ") + name;
+        ImGui::Text("Uniforms: %s", names.c_str());
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
-    if (content.empty()) {
-        error = "Shader file is empty: " + filepath;
-        std::cerr << error << "\n";
-        return "";
+    if (record.compile == CompileStatus::Ok) {
+        ImGui::TextUnformatted("Compiles");
+    } else if (record.compile == CompileStatus::Failed) {
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Compile error:");
+        ImGui::TextUnformatted(record.compileError.c_str());
     }
-    std::cerr << "Loaded shader: " << filepath << ", size: " << content.size() << " bytes\n";
-    return content;
+    for (const auto& cost : record.costs) ImGui::Text("%dx%d: %.2f ms", cost.width, cost.height, cost.ms);
+    ImGui::EndTooltip();
 }
 
-// Load all shader files from directory
-std::vector<std::string> loadShaderFiles(const std::string& directory, std::string& error) {
-    std::vector<std::string> shaderFiles;
-    try {
-        if (!fs::exists(directory)) {
-            error = "Shader directory does not exist: " + directory;
-            std::cerr << error << "\n";
-            return shaderFiles;
-        }
-        for (const auto& entry : fs::directory_iterator(directory)) {
-            std::string ext = entry.path().extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            if (ext == ".txt") {
-                shaderFiles.push_back(entry.path().string());
-                std::cerr << "Found .txt shader file: " << entry.path().string() << "\n";
-            } else {
-                std::cerr << "Skipped file (non-.txt extension): " << entry.path().string() << "\n";
+// Virtualized thumbnail grid of the shader library with a fuzzy filter.
+// Only the visible rows are laid out and only their thumbnails requested, so
+// the cost per frame does not depend on the library size. Hovering cycles
+// through the thumbnail times and shows the shader's index record. Returns
+// true when a shader was clicked (currentShader is updated).
+bool showShaderBrowser(ShaderLibrary& library, ShaderFilter& filter, char* query, size_t querySize,
+                       ShaderGallery& gallery, int& currentShader) {
+    if (!ImGui::CollapsingHeader("Shader Library", ImGuiTreeNodeFlags_DefaultOpen)) return false;
+    const auto& entries = library.entries();
+    ImGui::SetNextItemWidth(-1);
+    if (ImGui::InputTextWithHint("##filter", "Filter (fuzzy name or source text)", query, querySize)) filter.setQuery(query);
+    int count = filter.count(entries);
+    ImGui::Text("%d of %d shaders%s, %d thumbnails from cache, %d compiled", count, static_cast<int>(entries.size()),
+                library.scanning() ? " (scanning)" : filter.pending(entries) ? " (filtering)" : "",
+                gallery.cachedCount(), gallery.compiledCount());
+
+    bool clicked = false;
+    ImVec2 size(static_cast<float>(gallery.cellWidth), static_cast<float>(gallery.cellHeight));
+    const ImGuiStyle& style = ImGui::GetStyle();
+    float cellWidth = size.x + 2 * style.FramePadding.x;
+    float rowHeight = size.y + 2 * style.FramePadding.y + ImGui::GetTextLineHeight() + 2 * style.ItemSpacing.y;
+    ImGui::BeginChild("library", ImVec2(0, rowHeight * 2.5f), ImGuiChildFlags_Borders);
+    int columns = std::max(1, static_cast<int>((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) /
+                                               (cellWidth + style.ItemSpacing.x)));
+    int animatedFrame = static_cast<int>(ImGui::GetTime() * 2.0) % ShaderGallery::kFrames;
+    ImGuiListClipper clipper;
+    clipper.Begin((count + columns - 1) / columns, rowHeight);
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+            for (int column = 0; column < columns; ++column) {
+                int i = row * columns + column;
+                if (i >= count) break;
+                int index = filter.at(i);
+                const LibraryEntry& entry = entries[index];
+                if (column > 0) ImGui::SameLine();
+                ImGui::PushID(index);
+                ImGui::BeginGroup();
+                const ShaderGallery::Thumb& thumb = gallery.request(entry.path);
+                // A finished thumbnail tells whether the shader compiles
+                if (entry.record.compile == CompileStatus::Unknown && thumb.state != ShaderGallery::State::Pending) {
+                    library.setCompileResult(index, thumb.state == ShaderGallery::State::Ready, thumb.error);
+                }
+                GLuint texture;
+                float u0, v0, u1, v1;
+                if (gallery.frameImage(thumb, 0, texture, u0, v0, u1, v1)) {
+                    ImVec4 border = index == currentShader ? ImVec4(1.0f, 0.8f, 0.2f, 1.0f) : ImVec4(0, 0, 0, 0);
+                    ImVec2 cursor = ImGui::GetCursorScreenPos();
+                    if (ImGui::IsMouseHoveringRect(cursor, ImVec2(cursor.x + size.x, cursor.y + size.y))) {
+                        gallery.frameImage(thumb, animatedFrame, texture, u0, v0, u1, v1);
+                    }
+                    if (ImGui::ImageButton("thumb", (ImTextureID)(intptr_t)texture, size, ImVec2(u0, v0), ImVec2(u1, v1), border)) {
+                        currentShader = index;
+                        clicked = true;
+                    }
+                } else {
+                    bool failed = thumb.state == ShaderGallery::State::Failed;
+                    if (failed) ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.5f, 0.1f, 0.1f, 1.0f));
+                    if (ImGui::Button(failed ? "error" : "...", ImVec2(cellWidth, size.y + 2 * style.FramePadding.y))) {
+                        currentShader = index;
+                        clicked = true;
+                    }
+                    if (failed) ImGui::PopStyleColor();
+                    if (failed && ImGui::IsItemHovered()) ImGui::SetTooltip("%s", thumb.error.c_str());
+                }
+                // Names are shortened to the cell width
+                std::string label = entry.name;
+                while (label.size() > 4 && ImGui::CalcTextSize(label.c_str()).x > cellWidth) label.erase(label.size() - 4, 1);
+                if (label != entry.name) label.replace(label.size() - 3, 3, "...");
+                ImGui::TextUnformatted(label.c_str());
+                ImGui::EndGroup();
+                if (ImGui::IsItemHovered()) showShaderRecord(entry);
+                ImGui::PopID();
             }
         }
-        if (shaderFiles.empty()) {
-            error = "No .txt shader files found in directory: " + directory;
+    }
+    ImGui::EndChild();
+    return clicked;
+}
+
+// Background render jobs: state, progress, live thumbnail, pause and cancel
+void showRenderQueue(OfflineJobQueue& jobs) {
+    if (jobs.list().empty()) return;
+    ImGui::Separator();
+    ImGui::Text("Render Queue");
+    int pauseId = 0, resumeId = 0, cancelId = 0;
+    for (const auto& job : jobs.list()) {
+        ImGui::PushID(job->id);
+        if (job->thumbnail.valid()) {
+            // GL textures are bottom-up
+            ImGui::Image((ImTextureID)(intptr_t)job->thumbnail.texture,
+                         ImVec2(static_cast<float>(job->thumbnail.width), static_cast<float>(job->thumbnail.height)),
+                         ImVec2(0, 1), ImVec2(1, 0));
+            ImGui::SameLine();
+        }
+        ImGui::BeginGroup();
+        ImGui::Text("#%d %s -> %s", job->id, job->name.c_str(), job->outputFile.c_str());
+        ImGui::Text("%s, %dx%d, %d frames", jobStateName(job->state), job->settings.width, job->settings.height,
+                    job->settings.totalFrames);
+        char overlay[64];
+        if (job->state == JobState::Running && job->etaSeconds() > 0.0) {
+            snprintf(overlay, sizeof(overlay), "%.0f%%, ETA %.0f s", job->progress() * 100.0f, job->etaSeconds());
+        } else {
+            snprintf(overlay, sizeof(overlay), "%.0f%%", job->progress() * 100.0f);
+        }
+        ImGui::ProgressBar(job->progress(), ImVec2(240, 0), overlay);
+        if (!job->finished() && job->state != JobState::Finishing) {
+            if (job->state == JobState::Paused) {
+                if (ImGui::Button("Resume")) resumeId = job->id;
+            } else if (ImGui::Button("Pause")) {
+                pauseId = job->id;
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel")) cancelId = job->id;
+        }
+        if (!job->message.empty()) ImGui::TextWrapped("%s", job->message.c_str());
+        ImGui::EndGroup();
+        ImGui::PopID();
+    }
+    if (pauseId) jobs.setPaused(pauseId, true);
+    if (resumeId) jobs.setPaused(resumeId, false);
+    if (cancelId) jobs.cancel(cancelId);
+    if (ImGui::Button("Clear Finished")) jobs.clearFinished();
+}
+
+// Encode a frame store (written by a job) again with other settings, without
+// rendering; each encode runs on its own thread
+void showStoreEncodes(char* storePath, size_t pathSize, int& codecIndex, EncodeOptions& options,
+                      std::vector<std::unique_ptr<StoreEncode>>& encodes, std::string& errorMessage) {
+    if (!ImGui::TreeNode("Encode From Frame Store")) return;
+    const char* codecs[] = {"libx264", "libx265", "libvpx-vp9"};
+    const char* extensions[] = {".mp4", ".mp4", ".webm"};
+    ImGui::InputText("Frame Store", storePath, pathSize);
+    ImGui::Combo("Codec", &codecIndex, codecs, 3);
+    ImGui::SliderInt("CRF (-1 = default)", &options.crf, -1, 51);
+    ImGui::InputInt("Width (0 = store)", &options.width, 64);
+    ImGui::InputInt("Height (0 = store)", &options.height, 64);
+    options.width = std::max(options.width, 0) & ~1;
+    options.height = std::max(options.height, 0) & ~1;
+    if (ImGui::Button("Encode")) {
+        options.codec = codecs[codecIndex];
+        auto encode = std::make_unique<StoreEncode>();
+        std::string base = fs::path(storePath).replace_extension("").string() + "_" + options.codec;
+        std::string error;
+        if (encode->start(storePath, uniqueOutputPath(base, extensions[codecIndex]), options, error)) {
+            std::cout << "Encoding " << storePath << " -> " << encode->output() << "\n";
+            encodes.push_back(std::move(encode));
+        } else {
+            errorMessage = error;
             std::cerr << error << "\n";
         }
-    } catch (const std::exception& e) {
-        error = "Error reading shader directory: " + std::string(e.what());
-        std::cerr << error << "\n";
     }
-    return shaderFiles;
+    for (size_t i = 0; i < encodes.size(); ++i) {
+        const StoreEncode& encode = *encodes[i];
+        ImGui::PushID(static_cast<int>(i));
+        ImGui::Text("%s", encode.output().c_str());
+        ImGui::ProgressBar(encode.framesDone() / static_cast<float>(std::max(encode.totalFrames(), 1)), ImVec2(240, 0));
+        if (encode.finished()) {
+            ImGui::SameLine();
+            ImGui::TextUnformatted(encode.message().c_str());
+        } else {
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel")) encodes[i]->cancel();
+        }
+        ImGui::PopID();
+    }
+    ImGui::TreePop();
+}
+
+// Extra outputs filtered down from the master frame of an offline job
+void showOfflineSinks(OfflineSettings& offline) {
+    if (!ImGui::TreeNode("Extra Outputs")) return;
+    if (ImGui::Button("Add Video")) offline.sinks.push_back(OfflineSink());
+    ImGui::SameLine();
+    if (ImGui::Button("Add Poster Frame")) {
+        OfflineSink still;
+        still.kind = OfflineSink::Kind::Still;
+        still.width = offline.width;
+        still.height = offline.height;
+        offline.sinks.push_back(still);
+    }
+    for (size_t i = 0; i < offline.sinks.size(); ++i) {
+        OfflineSink& sink = offline.sinks[i];
+        ImGui::PushID(static_cast<int>(i));
+        ImGui::Text(sink.kind == OfflineSink::Kind::Video ? "Video" : "Poster frame");
+        ImGui::SameLine();
+        bool remove = ImGui::SmallButton("Remove");
+        int size[2] = {sink.width, sink.height};
+        ImGui::InputInt2("Size", size);
+        // Never larger than the master frame, and even for the encoder
+        sink.width = std::max(std::min(size[0], offline.width), 2) & ~1;
+        sink.height = std::max(std::min(size[1], offline.height), 2) & ~1;
+        if (sink.kind == OfflineSink::Kind::Still) {
+            ImGui::SliderInt("Frame", &sink.frame, 0, std::max(offline.totalFrames - 1, 0));
+        }
+        ImGui::PopID();
+        if (remove) {
+            offline.sinks.erase(offline.sinks.begin() + i);
+            break;
+        }
+    }
+    ImGui::TreePop();
+}
+
+// Rolling GPU time plot with percentile summary
+void plotTimingHistory(const char* label, const TimingHistory& history) {
+    char overlay[96];
+    snprintf(overlay, sizeof(overlay), "p50 %.2f  p95 %.2f  p99 %.2f ms",
+             history.percentile(0.50f), history.percentile(0.95f), history.percentile(0.99f));
+    ImGui::Text("%s: %.2f ms", label, history.latest());
+    ImGui::PlotHistogram(label, history.data(), history.size(), history.offset(), overlay,
+                         0.0f, std::max(history.maxValue() * 1.1f, 1.0f), ImVec2(0, 60));
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // ffmpeg or a progress reader exiting early must not kill the session;
+    // their writes fail instead and the job reports it
+    signal(SIGPIPE, SIG_IGN);
+
+    // Command line options
+    std::string tracePath;
+    ProgressReporter progress;
+    int gpuBudgetMB = -1;
+    int hostBudgetMB = -1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string optionError;
+        if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--progress-fd" && i + 1 < argc) {
+            if (!progress.openFd(std::atoi(argv[++i]), optionError)) {
+                std::cerr << optionError << "\n";
+                return -1;
+            }
+        } else if (arg == "--progress-socket" && i + 1 < argc) {
+            if (!progress.openUnixSocket(argv[++i], optionError)) {
+                std::cerr << optionError << "\n";
+                return -1;
+            }
+        } else if (arg == "--progress-interval" && i + 1 < argc) {
+            progress.setMinInterval(std::atof(argv[++i]));
+        } else if (arg == "--gpu-budget-mb" && i + 1 < argc) {
+            gpuBudgetMB = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--host-budget-mb" && i + 1 < argc) {
+            hostBudgetMB = std::max(0, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n"
+                      << "Usage: " << argv[0] << " [--trace trace.json] [--progress-fd N | --progress-socket PATH]"
+                      << " [--progress-interval SECONDS] [--gpu-budget-mb MB] [--host-budget-mb MB]\n";
+            return -1;
+        }
+    }
+    if (!tracePath.empty()) {
+        trace::setEnabled(true);
+        trace::setThreadName("main");
+    }
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW.\n";
@@ -148,6 +396,7 @@ int main() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     // Create window
     GLFWwindow* window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "Shader Preview", nullptr, nullptr);
@@ -163,12 +412,29 @@ int main() {
         glfwTerminate();
         return -1;
     }
-    glViewport(0, 0, WIN_WIDTH, WIN_HEIGHT);
+    int fbWidth = WIN_WIDTH, fbHeight = WIN_HEIGHT;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    glViewport(0, 0, fbWidth, fbHeight);
 
     // Log OpenGL version
     std::cerr << "OpenGL Version: " << glGetString(GL_VERSION) << "\n";
     std::cerr << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << "\n";
 
+    // Memory budgets: driver-reported VRAM (4 GB if unknown) and 80% of available RAM
+    if (gpuBudgetMB < 0) {
+        size_t vram = availableGpuMemory();
+        gpuBudgetMB = vram ? static_cast<int>(vram / (1024 * 1024)) : 4096;
+    }
+    if (hostBudgetMB < 0) {
+        hostBudgetMB = static_cast<int>(availableHostMemory() * 0.8 / (1024 * 1024));
+    }
+    ResourceRegistry::instance().gpuBudget = static_cast<size_t>(gpuBudgetMB) * 1024 * 1024;
+    ResourceRegistry::instance().hostBudget = static_cast<size_t>(hostBudgetMB) * 1024 * 1024;
+    // Double-buffered RGBA window surface (re-tracked on resize)
+    ResourceRegistry::instance().track(ResourceKind::Renderbuffer, 0, static_cast<size_t>(fbWidth) * fbHeight * 4 * 2,
+                                       "window", "default framebuffer");
+    std::cerr << "Memory budgets: GPU " << gpuBudgetMB << " MB, host " << hostBudgetMB << " MB\n";
+
     // Setup ImGui
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -177,28 +443,16 @@ int main() {
     ImGui_ImplOpenGL3_Init("#version 330");
     std::cerr << "ImGui version: " << ImGui::GetVersion() << "\n";
 
-    // Load shaders
+    // Scan the shader library in the background; the fallback shader runs
+    // until the scan finds the first shader
     std::string shaderDir = "shaders";
-    std::string loadError;
-    std::vector<std::string> shaderFiles = loadShaderFiles(shaderDir, loadError);
-    if (shaderFiles.empty()) {
-        std::cerr << loadError << ". Using fallback shader.\n";
-        shaderFiles.push_back("fallback");
-    }
-    // Store shader names in a stable vector
-    std::vector<std::string> shaderNames;
-    for (const auto& file : shaderFiles) {
-        std::string name = (file != "fallback") ? fs::path(file).filename().string() : "Fallback Shader";
-        shaderNames.push_back(name);
-        std::cerr << "Stored shader name: " << name << "\n";
-    }
-    // Create c_str pointers after all names are added
-    std::vector<const char*> shaderNamesCStr;
-    for (const auto& name : shaderNames) {
-        shaderNamesCStr.push_back(name.c_str());
-        std::cerr << "Added c_str to dropdown: " << name << "\n";
-    }
-    int currentShaderIndex = 0;
+    ShaderLibrary library;
+    library.scan(shaderDir, ".glslstudio_cache/library.index");
+    ShaderFilter libraryFilter;
+    char libraryQuery[128] = "";
+    int currentShaderIndex = -1;  // into library.entries(), -1 = fallback
+    std::string currentShaderName = "Fallback Shader";
+    bool selectFirstShader = true;
 
     // Compile initial shaders
     std::string shaderError;
@@ -209,12 +463,8 @@ int main() {
         glfwTerminate();
         return -1;
     }
-    std::string fragSource = shaderFiles[0] == "fallback" ? fallbackFragmentShaderSource : loadShaderFile(shaderFiles[0], shaderError);
-    if (!shaderError.empty()) {
-        std::cerr << shaderError << std::endl;
-        fragSource = fallbackFragmentShaderSource;
-    }
-    if (!compileShader(GL_FRAGMENT_SHADER, fragSource.c_str(), fragShader, shaderError)) {
+    std::string fragSource = fallbackFragmentShaderSource;
+    if (!compileShader(GL_FRAGMENT_SHADER, expandShaderSource(fragSource).c_str(), fragShader, shaderError)) {
         std::cerr << shaderError << std::endl;
         glDeleteShader(vertShader);
         fragSource = fallbackFragmentShaderSource;
@@ -241,76 +491,166 @@ int main() {
     GLint iResLoc = glGetUniformLocation(shaderProgram, "iResolution");
 
     // Setup full-screen quad
-    float quadVertices[] = {
-        -1.0f,  1.0f, 0.0f,  0.0f, 1.0f,
-        -1.0f, -1.0f, 0.0f,  0.0f, 0.0f,
-         1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
-        -1.0f,  1.0f, 0.0f,  0.0f, 1.0f,
-         1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
-         1.0f,  1.0f, 0.0f,  1.0f, 1.0f
-    };
     GLuint VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    createFullscreenQuad(VAO, VBO);
+    ResourceRegistry::instance().track(ResourceKind::Buffer, VBO, 6 * 5 * sizeof(float), "preview", "fullscreen quad");
 
     // GUI variables
-    int totalFrames = 1800;
-    float desiredDuration = 30.0f;
-    float slowdownFactor = 1.0f;
-    int offWidth = OFF_WIDTH;
-    int offHeight = OFF_HEIGHT;
-    bool startOfflineRender = false;
+    OfflineSettings offline;
+    offline.width = OFF_WIDTH;
+    offline.height = OFF_HEIGHT;
+    OfflineJobQueue jobs;
+    bool downscaleOverBudget = false;
+    char storePath[256] = "";  // frame store to encode again, the last one written by default
+    char incrementalOutput[256] = "output.mp4";  // video updated in place by incremental renders
+    int storeCodec = 0;
+    EncodeOptions storeOptions;
+    std::vector<std::unique_ptr<StoreEncode>> storeEncodes;
     double lastFrameTime = glfwGetTime();
     float fps = 0.0f;
-    std::string errorMessage = loadError;
+    std::string errorMessage;
     bool applyShader = false;
-    std::string loadedShadersList;
-    for (const auto& name : shaderNames) {
-        loadedShadersList += name + "\n";
-    }
+
+    // Thumbnails of the visible shaders, loaded from the disk cache or
+    // rendered a few milliseconds per loop iteration
+    ShaderGallery gallery;
 
     // Preview timing
-    double previewStart = glfwGetTime();
+    PreviewClock previewClock(glfwGetTime());
+    FramePacer pacer;
+    bool previewDirty = true;  // the paused preview must be redrawn (shader, step, size)
+    const double stepSeconds = 1.0 / 60.0;
+    TimelineCache timeline;
+    int timelineBudgetMB = timeline.budgetMB;  // slider value, applied when it is released
+    bool scrubbing = false;        // the timeline slider is being dragged
+    bool resumeAfterScrub = false;
+    bool timelineFilling = false;  // frames around the playhead are still missing
+    GpuTimer shaderTimer, uiTimer;
+    shaderTimer.init();
+    uiTimer.init();
+    TimingHistory shaderHistory, uiHistory;
+    double lastCostRecord = 0.0;  // glfwGetTime() of the last cost sent to the library index
+    // Whole preview frames are timed with a tag of the library shader and
+    // preview size they were drawn at (which dynamic resolution changes
+    // while their results are still in flight); 0 for everything else
+    auto costTag = [](int shader, int width, int height) {
+        return shader < 0 ? 0 : static_cast<uint64_t>(shader + 1) << 32 | static_cast<uint64_t>(width) << 16 |
+                                    static_cast<uint64_t>(height);
+    };
+
+    // Preview targets come from a pool so resizes reuse them. The preview
+    // resolution follows the window or a fixed preset; the shader draws into
+    // the lower-left of the target at the dynamic-resolution scale and is
+    // scaled (letterboxed) to the window.
+    RenderTargetPool previewPool;
+    RenderTarget* previewTarget = nullptr;
+    const char* previewSizeNames[] = {"Match Window", "1280x720", "1920x1080", "2560x1440", "3840x2160"};
+    const int previewSizes[][2] = {{0, 0}, {1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+    int previewSizeIndex = 0;
+    int baseWidth = 0, baseHeight = 0;  // preview resolution before dynamic scaling
+    DynamicResolution dynamicResolution;
+    ProgressiveRefiner refiner(previewPool);
+    TimeSlicedPreview slicedPreview(previewPool);
+    int previewWidth = fbWidth, previewHeight = fbHeight;
+
+    // Tile cost heatmap (diagnostics)
+    TileProfiler tileProfiler;
+    bool heatmapMode = false;
+    int heatmapCols = 16;
+    int heatmapRows = 9;
+    float heatmapOpacity = 0.45f;
+    bool exportHeatmap = false;
 
     // Main loop
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+        // Sleep until input arrives unless the preview is animating
+        pacer.applyVsync();
+        bool storeEncodesRunning = std::any_of(storeEncodes.begin(), storeEncodes.end(),
+                                               [](const std::unique_ptr<StoreEncode>& e) { return !e->finished(); });
+        bool slicedMode = slicedPreview.enabled && shaderProgram != 0 && !tileProfiler.active();
+        bool refining = previewClock.isPaused() && refiner.enabled && !refiner.converged() && shaderProgram != 0 && !slicedMode;
+        pacer.waitForFrame(window, !previewClock.isPaused() || previewDirty || tileProfiler.active() || refining ||
+                                   (slicedMode && slicedPreview.inProgress()) || jobs.busy() || storeEncodesRunning ||
+                                   gallery.busy() || timelineFilling ||
+                                   library.scanning() || libraryFilter.pending(library.entries()));
+
+        // Track the window size; nothing to draw while minimized
+        int newFbWidth, newFbHeight;
+        glfwGetFramebufferSize(window, &newFbWidth, &newFbHeight);
+        if (newFbWidth <= 0 || newFbHeight <= 0) {
+            glfwWaitEvents();
+            continue;
+        }
+        if (newFbWidth != fbWidth || newFbHeight != fbHeight) {
+            fbWidth = newFbWidth;
+            fbHeight = newFbHeight;
+            ResourceRegistry::instance().track(ResourceKind::Renderbuffer, 0, static_cast<size_t>(fbWidth) * fbHeight * 4 * 2,
+                                               "window", "default framebuffer");
+            previewDirty = true;
+        }
 
         // Calculate FPS
         double currentTime = glfwGetTime();
         fps = 1.0f / static_cast<float>(currentTime - lastFrameTime);
         lastFrameTime = currentTime;
 
+        // Collect GPU timings issued a few frames ago
+        double gpuMs;
+        uint64_t tag, sampleTag = 0;
+        double sampleMs = 0.0;
+        while (shaderTimer.poll(gpuMs, false, &tag)) {
+            shaderHistory.add(gpuMs);
+            if (!slicedMode) dynamicResolution.update(gpuMs);
+            if (tag) {
+                sampleTag = tag;
+                sampleMs = gpuMs;
+            }
+        }
+        // About once a second the measured cost goes into the library index,
+        // under the size that frame was drawn at
+        if (sampleTag && currentTime - lastCostRecord > 1.0) {
+            int shader = static_cast<int>(sampleTag >> 32) - 1;
+            if (shader < static_cast<int>(library.entries().size())) {
+                library.recordCost(shader, static_cast<int>(sampleTag >> 16 & 0xffff), static_cast<int>(sampleTag & 0xffff),
+                                   static_cast<float>(sampleMs));
+            }
+            lastCostRecord = currentTime;
+        }
+        while (uiTimer.poll(gpuMs)) uiHistory.add(gpuMs);
+        tileProfiler.collect();
+
         // Start ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // Pick up shaders found by the background scan; the first one is applied
+        bool wasScanning = library.scanning();
+        library.sync();
+        if (wasScanning && !library.scanning() && !library.error().empty()) {
+            errorMessage = library.error() + ". Using fallback shader.";
+            std::cerr << errorMessage << "\n";
+        }
+        if (selectFirstShader && !library.entries().empty()) {
+            selectFirstShader = false;
+            currentShaderIndex = 0;
+            applyShader = true;
+        }
+        libraryFilter.update(library.entries());
+
         // UI panel
-        ImGui::SetNextWindowSize(ImVec2(400, 500));
+        ImGui::SetNextWindowSize(ImVec2(420, 700));
         ImGui::Begin("Shader Controls");
-        // std::cerr << "Rendering ImGui Shader Controls window\n";
-        ImGui::Text("Shader Selection");
-        ImGui::Combo("Shader", &currentShaderIndex, shaderNamesCStr.data(), shaderNamesCStr.size());
-        ImGui::Text("Debug: Apply button follows");
+        ImGui::Text("Shader: %s", currentShaderName.c_str());
         if (ImGui::Button("Apply Shader")) {
             applyShader = true;
-            std::cerr << "Apply Shader button clicked\n";
         }
 
-        // Display loaded shaders
+        // Shader library browser; clicking a thumbnail applies it
         ImGui::Separator();
-        ImGui::Text("Loaded Shaders:");
-        ImGui::TextWrapped("%s", loadedShadersList.c_str());
+        if (showShaderBrowser(library, libraryFilter, libraryQuery, sizeof(libraryQuery), gallery, currentShaderIndex)) {
+            applyShader = true;
+        }
 
         // Apply shader if button pressed
         if (applyShader) {
@@ -322,13 +662,19 @@ int main() {
                 shaderProgram = 0;
                 continue;
             }
-            std::string newFragSource = shaderFiles[currentShaderIndex] == "fallback" ? fallbackFragmentShaderSource : loadShaderFile(shaderFiles[currentShaderIndex], errorMessage);
+            std::string shaderPath = currentShaderIndex >= 0 ? library.entries()[currentShaderIndex].path : "fallback";
+            currentShaderName = currentShaderIndex >= 0 ? library.entries()[currentShaderIndex].name : "Fallback Shader";
+            std::string newFragSource = shaderPath == "fallback" ? fallbackFragmentShaderSource : loadShaderFile(shaderPath, errorMessage);
             if (!errorMessage.empty()) {
                 std::cerr << errorMessage << std::endl;
                 newFragSource = fallbackFragmentShaderSource;
             }
-            std::cerr << "Shader content for " << shaderNames[currentShaderIndex] << ":\n" << newFragSource << "\n";
-            if (!compileShader(GL_FRAGMENT_SHADER, newFragSource.c_str(), fragShader, shaderError)) {
+            std::cerr << "Shader content for " << currentShaderName << ":\n" << newFragSource << "\n";
+            bool compiled = compileShader(GL_FRAGMENT_SHADER, expandShaderSource(newFragSource).c_str(), fragShader, shaderError);
+            if (currentShaderIndex >= 0 && errorMessage.empty()) {
+                library.setCompileResult(currentShaderIndex, compiled, compiled ? "" : shaderError);
+            }
+            if (!compiled) {
                 std::cerr << shaderError << std::endl;
                 glDeleteShader(vertShader);
                 newFragSource = fallbackFragmentShaderSource;
@@ -348,9 +694,14 @@ int main() {
             }
             glDeleteShader(vertShader);
             glDeleteShader(fragShader);
+            fragSource = newFragSource;
+            gallery.refresh(shaderPath);
+            timeline.clear();
+            lastCostRecord = glfwGetTime();  // timings in flight belong to the previous shader
             iTimeLoc = glGetUniformLocation(shaderProgram, "iTime");
             iResLoc = glGetUniformLocation(shaderProgram, "iResolution");
-            std::cerr << "Applied shader: " << shaderNames[currentShaderIndex] << ", iTimeLoc: " << iTimeLoc << ", iResLoc: " << iResLoc << "\n";
+            std::cerr << "Applied shader: " << currentShaderName << ", iTimeLoc: " << iTimeLoc << ", iResLoc: " << iResLoc << "\n";
+            previewDirty = true;
         }
 
         // Display errors
@@ -363,29 +714,307 @@ int main() {
         ImGui::Separator();
         ImGui::Text("Render Settings");
         ImGui::Text("FPS: %.1f", fps);
-        ImGui::InputInt("Render Width", &offWidth);
-        ImGui::InputInt("Render Height", &offHeight);
-        ImGui::InputInt("Total Frames", &totalFrames);
-        ImGui::InputFloat("Duration (seconds)", &desiredDuration, 1.0f, 100.0f, "%.1f");
-        ImGui::InputFloat("Slowdown Factor", &slowdownFactor, 0.1f, 10.0f, "%.2f");
-        if (ImGui::Button("Start Offline Render")) {
-            startOfflineRender = true;
+        plotTimingHistory("Shader GPU", shaderHistory);
+        plotTimingHistory("ImGui GPU", uiHistory);
+        if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution.enabled)) dynamicResolution.reset();
+        if (dynamicResolution.enabled) {
+            ImGui::SliderFloat("Target Shader ms", &dynamicResolution.targetMs, 2.0f, 50.0f, "%.1f");
+            ImGui::SliderFloat("Min Scale", &dynamicResolution.minScale, 0.1f, 1.0f, "%.2f");
+        }
+        if (ImGui::Combo("Preview Size", &previewSizeIndex, previewSizeNames, IM_ARRAYSIZE(previewSizeNames))) {
+            previewDirty = true;
+        }
+        ImGui::Text("Preview: %dx%d (%.0f%%), %d target allocations", previewWidth, previewHeight,
+                    dynamicResolution.scale() * 100.0f, previewPool.allocations());
+
+        // Preview playback and loop pacing (Space pauses, Right steps)
+        bool keyboardFree = !ImGui::GetIO().WantCaptureKeyboard;
+        if (ImGui::Button(previewClock.isPaused() ? "Resume" : "Pause") || (keyboardFree && ImGui::IsKeyPressed(ImGuiKey_Space, false))) {
+            previewClock.setPaused(!previewClock.isPaused(), glfwGetTime());
+            previewDirty = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Step") || (keyboardFree && ImGui::IsKeyPressed(ImGuiKey_RightArrow))) {
+            previewClock.setPaused(true, glfwGetTime());
+            previewClock.step(stepSeconds);
+            previewDirty = true;
+        }
+        ImGui::SameLine();
+        ImGui::Text("t = %.3f s", previewClock.time(glfwGetTime()));
+
+        // Timeline over the clip's iTime range; dragging pauses the preview and
+        // shows cached low-resolution frames where they exist
+        float clipSeconds = std::max(offline.duration * offline.slowdown, 0.0f);
+        float scrubTime = std::min(static_cast<float>(previewClock.time(glfwGetTime())), clipSeconds);
+        if (ImGui::SliderFloat("Timeline", &scrubTime, 0.0f, clipSeconds, "%.2f s")) {
+            previewClock.seek(scrubTime, glfwGetTime());
+            previewDirty = true;
+        }
+        if (ImGui::IsItemActivated()) {
+            resumeAfterScrub = !previewClock.isPaused();
+            previewClock.setPaused(true, glfwGetTime());
+        }
+        scrubbing = ImGui::IsItemActive();
+        if (ImGui::IsItemDeactivated() && resumeAfterScrub) {
+            previewClock.setPaused(false, glfwGetTime());
+        }
+        ImGui::Checkbox("Cache Timeline Frames", &timeline.enabled);
+        if (timeline.enabled) {
+            ImGui::SameLine();
+            ImGui::Text("%d / %d frames", timeline.cachedFrames(), timeline.slots());
+            // Resizing drops every cached frame, so apply the new size once, on release
+            ImGui::SliderInt("Timeline Cache (MB)", &timelineBudgetMB, 16, 2048);
+            if (ImGui::IsItemDeactivatedAfterEdit()) {
+                timeline.budgetMB = timelineBudgetMB;
+                timeline.destroy();
+            }
+        } else if (timeline.cachedFrames() > 0) {
+            timeline.destroy();
+        }
+        ImGui::Checkbox("VSync", &pacer.vsync);
+        ImGui::SameLine();
+        ImGui::Checkbox("Redraw only on change", &pacer.onDemand);
+        ImGui::SliderInt("Frame Cap (0 = off)", &pacer.frameCap, 0, 240);
+        ImGui::SliderInt("Unfocused Cap", &pacer.unfocusedCap, 1, 60);
+        ImGui::Checkbox("Refine When Paused", &refiner.enabled);
+        if (refiner.enabled) {
+            ImGui::SameLine();
+            ImGui::Text("%d / %d samples", std::min(refiner.samples(), refiner.maxSamples), refiner.maxSamples);
+            ImGui::SliderInt("Refine Samples", &refiner.maxSamples, 1, 256);
+        }
+        if (ImGui::Checkbox("Time-Sliced Preview", &slicedPreview.enabled)) {
+            if (!slicedPreview.enabled) slicedPreview.destroy();
+            previewDirty = true;
+        }
+        if (slicedPreview.enabled) {
+            ImGui::SliderInt("Slice Tile Size", &slicedPreview.tileSize, 64, 1024);
+            ImGui::SliderInt("Tiles per Frame", &slicedPreview.tilesPerFrame, 1, 64);
+            ImGui::ProgressBar(slicedPreview.progress(), ImVec2(-1, 0));
+        }
+        ImGui::InputInt("Render Width", &offline.width);
+        ImGui::InputInt("Render Height", &offline.height);
+        ImGui::InputInt("Total Frames", &offline.totalFrames);
+        ImGui::InputFloat("Duration (seconds)", &offline.duration, 1.0f, 100.0f, "%.1f");
+        ImGui::InputFloat("Slowdown Factor", &offline.slowdown, 0.1f, 10.0f, "%.2f");
+        ImGui::InputInt("Tile Size (0 = auto)", &offline.tileSize, 256);
+        offline.tileSize = std::max(offline.tileSize, 0);
+        ImGui::InputInt("Strip Height (0 = whole frame)", &offline.stripHeight, 64);
+        offline.stripHeight = std::max(offline.stripHeight, 0);
+        ImGui::SliderInt("SSAA Factor", &offline.supersample, 1, 4);
+        int resolveFilter = static_cast<int>(offline.resolveFilter);
+        const char* resolveFilters[] = {"Box", "Lanczos"};
+        if (ImGui::Combo("SSAA Filter", &resolveFilter, resolveFilters, 2)) {
+            offline.resolveFilter = static_cast<ResolveFilter>(resolveFilter);
+        }
+        ImGui::SliderInt("Motion Blur Samples", &offline.motionBlurSamples, 1, 64);
+        ImGui::SliderFloat("Shutter Angle", &offline.shutterAngle, 0.0f, 360.0f, "%.0f deg");
+        int output = static_cast<int>(offline.output);
+        const char* outputs[] = {"Video", "Frame Store", "Video + Frame Store"};
+        if (ImGui::Combo("Output", &output, outputs, 3)) offline.output = static_cast<OfflineOutput>(output);
+        if (offline.output != OfflineOutput::Video) ImGui::Checkbox("Compress Frame Store (LZ4)", &offline.compressFrameStore);
+        if (offline.output != OfflineOutput::FrameStore) {
+            ImGui::InputInt("Segment Frames (0 = one encoder)", &offline.segmentFrames, 60);
+            offline.segmentFrames = std::max(offline.segmentFrames, 0);
+            if (offline.segmentFrames > 0 || offline.incremental) {
+                ImGui::SliderInt("Encoder Processes", &offline.encoderProcesses, 1, 16);
+            }
+            if (offline.output == OfflineOutput::Video) ImGui::Checkbox("Incremental (update output)", &offline.incremental);
+            if (offline.incremental && offline.output == OfflineOutput::Video) ImGui::InputText("Output File", incrementalOutput, sizeof(incrementalOutput));
+        }
+        showOfflineSinks(offline);
+        ImGui::Checkbox("Cache Offline Frames", &jobs.frameCache.enabled);
+        if (jobs.frameCache.enabled) {
+            ImGui::SliderInt("Frame Cache (MB)", &jobs.frameCache.budgetMB, 256, 65536, "%d", ImGuiSliderFlags_Logarithmic);
+            if (jobs.frameCache.hitCount() + jobs.frameCache.missCount() > 0) {
+                ImGui::Text("Frame cache: %d frames, %.0f MB, %d hits, %d misses", jobs.frameCache.frameCount(),
+                            ResourceRegistry::toMB(jobs.frameCache.sizeBytes()), jobs.frameCache.hitCount(),
+                            jobs.frameCache.missCount());
+            }
+        }
+        if (ImGui::Button("Start Offline Render") && shaderProgram != 0) {
+            // Validate now so an impossible job is reported here; the queue
+            // plans again (against the budgets of the moment) when it starts
+            OfflineSettings planned = offline;
+            std::string planMessage;
+            bool incremental = offline.incremental && offline.output == OfflineOutput::Video;
+            if (incremental && jobs.claims(incrementalOutput)) {
+                errorMessage = std::string("A queued job already writes ") + incrementalOutput;
+                std::cerr << errorMessage << "\n";
+            } else if (planOfflineJob(planned, downscaleOverBudget, planMessage)) {
+                std::string outputPath = incremental ? std::string(incrementalOutput)
+                    : offline.output == OfflineOutput::FrameStore ? uniqueOutputPath("frames", ".gsframes", &jobs)
+                    : uniqueOutputPath("output", ".mp4", &jobs);
+                jobs.enqueue(currentShaderName, fragSource, offline, outputPath);
+                if (offline.output != OfflineOutput::Video) {
+                    snprintf(storePath, sizeof(storePath), "%s", frameStorePath(offline, outputPath).c_str());
+                }
+            } else {
+                errorMessage = planMessage;
+                std::cerr << planMessage << "\n";
+            }
+        }
+        jobs.allowDownscale = downscaleOverBudget;
+        showRenderQueue(jobs);
+        showStoreEncodes(storePath, sizeof(storePath), storeCodec, storeOptions, storeEncodes, errorMessage);
+
+        // Memory accounting
+        ImGui::Separator();
+        ImGui::Text("Memory");
+        showResourcePanel(gpuBudgetMB, hostBudgetMB, downscaleOverBudget);
+
+        // Diagnostics
+        ImGui::Separator();
+        ImGui::Text("Diagnostics");
+        bool heatmapChanged = ImGui::Checkbox("Tile Cost Heatmap", &heatmapMode);
+        if (heatmapMode) {
+            heatmapChanged |= ImGui::SliderInt("Tile Columns", &heatmapCols, 1, 64);
+            heatmapChanged |= ImGui::SliderInt("Tile Rows", &heatmapRows, 1, 36);
+            ImGui::SliderFloat("Heatmap Opacity", &heatmapOpacity, 0.0f, 1.0f, "%.2f");
+            ImGui::Text("Sum of tiles: %.2f ms, hottest tile: %.3f ms", tileProfiler.totalCost(), tileProfiler.maxCost());
+            if (ImGui::Button("Export Heatmap (PNG + CSV)")) {
+                exportHeatmap = true;
+            }
+        }
+        if (heatmapChanged) {
+            if (heatmapMode) tileProfiler.resize(heatmapCols, heatmapRows);
+            else tileProfiler.destroy();
+        }
+        if (tileProfiler.active()) {
+            drawHeatmapOverlay(tileProfiler, previewWidth, previewHeight, fbWidth, fbHeight, heatmapOpacity);
         }
         ImGui::End();
 
-        // Render
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        if (shaderProgram != 0) {
+        // Background offline jobs get a few milliseconds of every iteration
+        jobs.update(VAO, &progress);
+        std::string galleryError;
+        if (!gallery.update(VAO, galleryError)) {
+            errorMessage = galleryError;
+            std::cerr << galleryError << "\n";
+        }
+
+        // Render the shader off-screen; the heatmap holds the scale steady so
+        // its tile costs stay comparable. A paused, unchanged preview keeps
+        // its last image and only the UI is redrawn.
+        int wantWidth = previewSizes[previewSizeIndex][0] ? previewSizes[previewSizeIndex][0] : fbWidth;
+        int wantHeight = previewSizes[previewSizeIndex][1] ? previewSizes[previewSizeIndex][1] : fbHeight;
+        if (!previewTarget || wantWidth != baseWidth || wantHeight != baseHeight) {
+            if (previewTarget) previewPool.release(previewTarget);
+            std::string targetError;
+            previewTarget = previewPool.acquire(wantWidth, wantHeight, GL_RGB8, "preview", targetError);
+            if (!previewTarget) {
+                errorMessage = targetError;
+                std::cerr << targetError << "\n";
+                break;
+            }
+            baseWidth = wantWidth;
+            baseHeight = wantHeight;
+            previewWidth = baseWidth;
+            previewHeight = baseHeight;
+        }
+        // Fill the timeline cache around the playhead (at the preview's aspect)
+        timeline.configure(clipSeconds, baseWidth, baseHeight);
+        float playhead = std::min(static_cast<float>(previewClock.time(glfwGetTime())), clipSeconds);
+        std::string timelineError;
+        if (!timeline.fill(shaderProgram, VAO, playhead, timelineError)) {
+            errorMessage = timelineError;
+            std::cerr << timelineError << "\n";
+            timeline.enabled = false;
+        }
+        timelineFilling = timeline.enabled && shaderProgram != 0 && !timeline.complete(playhead);
+
+        // While scrubbing, a cached timeline frame stands in for the shader
+        const RenderTarget* scrubFrame = scrubbing && timeline.enabled && !tileProfiler.active()
+            ? timeline.lookup(playhead) : nullptr;
+        slicedMode = slicedPreview.enabled && shaderProgram != 0 && !tileProfiler.active() && !scrubFrame;
+        bool drawPreview = !slicedMode && !scrubFrame &&
+                           (!previewClock.isPaused() || previewDirty || tileProfiler.active() || exportHeatmap);
+        if (drawPreview) {
+            if (!tileProfiler.active()) dynamicResolution.renderSize(baseWidth, baseHeight, previewWidth, previewHeight);
+            glBindFramebuffer(GL_FRAMEBUFFER, previewTarget->fbo);
+            glViewport(0, 0, previewWidth, previewHeight);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            previewDirty = false;
+            refiner.reset();
+        }
+        if (drawPreview && shaderProgram != 0) {
+            // Tile queries replace the whole-frame query (time queries cannot nest)
+            if (!tileProfiler.active()) shaderTimer.begin(costTag(currentShaderIndex, previewWidth, previewHeight));
             glUseProgram(shaderProgram);
-            float elapsed = static_cast<float>(glfwGetTime() - previewStart);
+            float elapsed = static_cast<float>(previewClock.time(glfwGetTime()));
             if (iTimeLoc != -1) glUniform1f(iTimeLoc, elapsed);
-            if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(WIN_WIDTH), static_cast<float>(WIN_HEIGHT), 1.0f);
+            if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(previewWidth), static_cast<float>(previewHeight), 1.0f);
             glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            if (tileProfiler.active()) {
+                tileProfiler.drawTiled(previewWidth, previewHeight, [] { glDrawArrays(GL_TRIANGLES, 0, 6); });
+            } else {
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
             glBindVertexArray(0);
+            if (!tileProfiler.active()) shaderTimer.end();
         }
 
+        // Export the heatmap over the frame that was just drawn (one-off stall)
+        if (exportHeatmap) {
+            exportHeatmap = false;
+            std::vector<unsigned char> frame(static_cast<size_t>(previewWidth) * previewHeight * 3);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            trackHostBuffer(frame.data(), frame.size(), "heatmap", "export readback");
+            glReadPixels(0, 0, previewWidth, previewHeight, GL_RGB, GL_UNSIGNED_BYTE, frame.data());
+            std::string baseName = "heatmap_" + fs::path(currentShaderName).stem().string();
+            std::string pngPath = uniqueOutputPath(baseName, ".png");
+            std::string csvPath = pngPath.substr(0, pngPath.size() - 4) + ".csv";
+            std::string exportError;
+            if (tileProfiler.exportPng(pngPath, frame, previewWidth, previewHeight, heatmapOpacity, exportError) &&
+                tileProfiler.exportCsv(csvPath, previewWidth, previewHeight, exportError)) {
+                std::cerr << "Heatmap exported to " << pngPath << " and " << csvPath << "\n";
+            } else {
+                errorMessage = exportError;
+                std::cerr << exportError << "\n";
+            }
+            releaseHostBuffer(frame.data());
+        }
+
+        // Time-sliced mode draws a few tiles of the next full-resolution frame
+        // per iteration; a paused preview stops once its frame is complete
+        if (slicedMode) {
+            if (previewDirty) slicedPreview.restart();
+            if (!previewClock.isPaused() || previewDirty || slicedPreview.inProgress() || !slicedPreview.hasFrame()) {
+                std::string sliceError;
+                shaderTimer.begin();
+                bool ok = slicedPreview.step(shaderProgram, VAO, static_cast<float>(previewClock.time(glfwGetTime())),
+                                             baseWidth, baseHeight, sliceError);
+                shaderTimer.end();
+                if (!ok && !sliceError.empty()) {
+                    errorMessage = sliceError;
+                    std::cerr << sliceError << "\n";
+                    slicedPreview.enabled = false;
+                    slicedMode = false;
+                }
+            }
+            previewDirty = false;
+        }
+
+        // A paused preview is refined with jittered full-resolution samples,
+        // starting from the (possibly reduced-resolution) frame drawn above
+        bool showRefined = previewClock.isPaused() && refiner.enabled && shaderProgram != 0 && !tileProfiler.active() &&
+                           !slicedMode && !scrubFrame;
+        if (showRefined && !drawPreview && !refiner.converged()) {
+            std::string refineError;
+            float pausedTime = static_cast<float>(previewClock.time(glfwGetTime()));
+            if (!refiner.addSample(shaderProgram, VAO, pausedTime, baseWidth, baseHeight, refineError)) {
+                errorMessage = refineError;
+                std::cerr << refineError << "\n";
+                refiner.enabled = false;
+            }
+        }
+
+        // Scale the preview to the window
+        if (scrubFrame) presentPreview(scrubFrame, timeline.width(), timeline.height(), fbWidth, fbHeight);
+        else if (slicedMode) slicedPreview.present(fbWidth, fbHeight);
+        else if (showRefined && refiner.samples() > 0) refiner.present(fbWidth, fbHeight);
+        else presentPreview(previewTarget, previewWidth, previewHeight, fbWidth, fbHeight);
+
         // Check OpenGL errors
         GLenum err = glGetError();
         if (err != GL_NO_ERROR) {
@@ -395,87 +1024,30 @@ int main() {
 
         // Render ImGui
         ImGui::Render();
+        uiTimer.begin();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        uiTimer.end();
 
         glfwSwapBuffers(window);
 
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS || startOfflineRender) {
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
             break;
         }
     }
 
-    // Offline rendering
-    if (startOfflineRender && shaderProgram != 0) {
-        // Generate unique output filename
-        std::string baseName = "output";
-        std::string extension = ".mp4";
-        std::string outputFile = baseName + extension;
-        int counter = 1;
-        while (fs::exists(outputFile)) {
-            std::ostringstream oss;
-            oss << baseName << "_" << counter << extension;
-            outputFile = oss.str();
-            counter++;
-        }
-
-        // FFmpeg command
-        std::string ffmpegCmd = "ffmpeg -y -f rawvideo -pixel_format rgb24 -video_size " +
-                                std::to_string(offWidth) + "x" + std::to_string(offHeight) +
-                                " -framerate 60 -i - -c:v libx264 -pix_fmt yuv420p " + outputFile;
-
-        // Offline Render Setup
-        std::cout << "Starting offline render...\n";
-        FILE* ffmpegPipe = popen(ffmpegCmd.c_str(), "w");
-        if (!ffmpegPipe) {
-            std::cerr << "Failed to open ffmpeg pipe.\n";
-        } else {
-            // Setup off-screen framebuffer
-            GLuint fbo, texColorBuffer;
-            glGenFramebuffers(1, &fbo);
-            glGenTextures(1, &texColorBuffer);
-            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-            glBindTexture(GL_TEXTURE_2D, texColorBuffer);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, offWidth, offHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texColorBuffer, 0);
-            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-                std::cerr << "Framebuffer incomplete!\n";
-            }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-            // Offline render loop
-            std::vector<unsigned char> frameBuffer(offWidth * offHeight * 3);
-            for (int frame = 0; frame < totalFrames; ++frame) {
-                float simulatedTime = (frame / static_cast<float>(totalFrames - 1)) * desiredDuration * slowdownFactor;
-
-                glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-                glViewport(0, 0, offWidth, offHeight);
-                glClear(GL_COLOR_BUFFER_BIT);
-                glUseProgram(shaderProgram);
-                if (iTimeLoc != -1) glUniform1f(iTimeLoc, simulatedTime);
-                if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(offWidth), static_cast<float>(offHeight), 1.0f);
-                glBindVertexArray(VAO);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                glBindVertexArray(0);
-                glFinish();
-
-                glReadPixels(0, 0, offWidth, offHeight, GL_RGB, GL_UNSIGNED_BYTE, frameBuffer.data());
-                if (fwrite(frameBuffer.data(), 1, frameBuffer.size(), ffmpegPipe) != frameBuffer.size()) {
-                    std::cerr << "Error writing frame " << frame << " to ffmpeg.\n";
-                }
-                std::cout << "Rendered frame " << frame + 1 << " of " << totalFrames << "\n";
-            }
-
-            // Cleanup
-            pclose(ffmpegPipe);
-            std::cout << "Offline render complete. Saved as " << outputFile << "\n";
-            glDeleteFramebuffers(1, &fbo);
-            glDeleteTextures(1, &texColorBuffer);
-        }
-    }
-
-    // Cleanup
+    // Cleanup (unfinished jobs keep the frames they encoded)
+    jobs.destroy();
+    storeEncodes.clear();
+    gallery.destroy();
+    library.stop();
+    if (!library.save(shaderError)) std::cerr << shaderError << std::endl;
+    timeline.destroy();
+    tileProfiler.destroy();
+    refiner.destroy();
+    slicedPreview.destroy();
+    previewPool.destroy();
+    shaderTimer.destroy();
+    uiTimer.destroy();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     if (shaderProgram != 0) glDeleteProgram(shaderProgram);
@@ -484,5 +1056,15 @@ int main() {
     ImGui::DestroyContext();
     glfwDestroyWindow(window);
     glfwTerminate();
+
+    if (!tracePath.empty()) {
+        std::string traceError;
+        if (!trace::dump(tracePath, traceError)) {
+            std::cerr << traceError << "\n";
+        } else {
+            if (!traceError.empty()) std::cerr << traceError << "\n";
+            std::cerr << "Trace written to " << tracePath << "\n";
+        }
+    }
     return 0;
 }
@@ -0,0 +1,295 @@
+#pragma once
+// Queue of offline renders that run in the background of the interactive
+// loop. Each job owns its shader program and an OfflineRenderer (with its own
+// targets, readback buffers and encoder pipe) on the preview's GL context;
+// update() is called once per loop iteration and advances the head job a
+// tile, strip or untiled draw at a time until a small time budget is spent,
+// the GPU is still busy with the job's last draw or the encoder queue is full,
+// so the preview and UI keep running within frames. A done or cancelled job
+// closes its encoders on a worker thread while it shows as finishing. Jobs
+// run one at a time in FIFO order, and all of them read and fill the same
+// on-disk frame cache.
+#include "offline_render.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+
+enum class JobState { Queued, Running, Paused, Finishing, Done, Failed, Cancelled };
+
+inline const char* jobStateName(JobState state) {
+    switch (state) {
+        case JobState::Queued: return "queued";
+        case JobState::Running: return "running";
+        case JobState::Paused: return "paused";
+        case JobState::Finishing: return "finishing";
+        case JobState::Done: return "done";
+        case JobState::Failed: return "failed";
+        case JobState::Cancelled: return "cancelled";
+    }
+    return "?";
+}
+
+struct OfflineJob {
+    int id = 0;
+    std::string name;
+    std::string fragSource;      // unexpanded source, compiled when the job starts
+    OfflineSettings settings;
+    std::string outputFile;
+    JobState state = JobState::Queued;
+    std::string message;         // plan note, error or result
+    GLuint program = 0;
+    std::unique_ptr<OfflineRenderer> renderer;
+    RenderTarget thumbnail;      // shader drawn at the last rendered frame's time
+    double activeSeconds = 0.0;  // wall time spent running (for the ETA)
+
+    bool finished() const {
+        return state == JobState::Done || state == JobState::Failed || state == JobState::Cancelled;
+    }
+
+    float progress() const {
+        if (state == JobState::Done) return 1.0f;
+        if (!renderer || settings.totalFrames <= 0) return 0.0f;
+        return renderer->framesDone() / static_cast<float>(settings.totalFrames);
+    }
+
+    // Remaining seconds at the job's own rate, including time yielded to the preview
+    double etaSeconds() const {
+        if (!renderer || renderer->framesDone() == 0) return 0.0;
+        int remaining = settings.totalFrames - renderer->framesDone();
+        return activeSeconds / renderer->framesDone() * remaining;
+    }
+};
+
+class OfflineJobQueue {
+public:
+    double sliceBudgetMs = 8.0;     // render time per loop iteration (at least one tile or strip)
+    bool allowDownscale = false;    // passed to planOfflineJob
+    int thumbnailWidth = 192;
+    FrameCache frameCache;          // shared by all jobs; see frame_cache.h
+
+    int enqueue(const std::string& name, const std::string& fragSource, const OfflineSettings& settings,
+                const std::string& outputFile) {
+        auto job = std::make_unique<OfflineJob>();
+        job->id = nextId++;
+        job->name = name;
+        job->fragSource = fragSource;
+        job->settings = settings;
+        job->outputFile = outputFile;
+        std::cout << "Queued offline render " << job->id << ": " << name << " -> " << outputFile << "\n";
+        jobs.push_back(std::move(job));
+        return jobs.back()->id;
+    }
+
+    // Advance the head job; a paused head holds the jobs queued behind it
+    void update(GLuint vao, ProgressReporter* reporter) {
+        OfflineJob* job = head();
+        if (!job || job->state == JobState::Paused) {
+            sliceStart = {};
+            return;
+        }
+        if (job->state == JobState::Finishing) {
+            if (job->renderer->closed()) complete(*job);
+            return;
+        }
+        if (job->state == JobState::Queued && !startJob(*job, vao, reporter)) return;
+        TRACE_ZONE("offline slice");
+        auto start = std::chrono::steady_clock::now();
+        if (sliceStart.time_since_epoch().count() != 0) {
+            // Count the time the preview ran since the last slice as job time too
+            job->activeSeconds += std::chrono::duration<double>(start - sliceStart).count();
+        }
+        bool more = true;
+        do {
+            more = job->renderer->renderStep();
+        } while (more && !job->renderer->waitingForGpu() && !job->renderer->waitingForEncoder() &&
+                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < sliceBudgetMs);
+        sliceStart = std::chrono::steady_clock::now();
+        job->activeSeconds += std::chrono::duration<double>(sliceStart - start).count();
+
+        if (sliceStart - lastThumbnail > std::chrono::milliseconds(250) || !more) {
+            drawThumbnail(*job, vao);
+            lastThumbnail = sliceStart;
+        }
+        if (!more) {
+            job->renderer->beginClose(false);
+            job->state = JobState::Finishing;
+        }
+    }
+
+    void setPaused(int id, bool paused) {
+        OfflineJob* job = find(id);
+        if (!job || job->finished() || job->state == JobState::Finishing) return;
+        if (paused && job->state != JobState::Paused) {
+            job->state = JobState::Paused;
+        } else if (!paused && job->state == JobState::Paused) {
+            job->state = job->renderer ? JobState::Running : JobState::Queued;
+        }
+        sliceStart = {};
+    }
+
+    // Stop a job; frames already encoded are kept in its output file once
+    // it has finished closing
+    void cancel(int id) {
+        OfflineJob* job = find(id);
+        if (!job || job->finished() || job->state == JobState::Finishing) return;
+        if (job->renderer) {
+            job->renderer->beginClose(true);
+            job->state = JobState::Finishing;
+        } else {
+            job->state = JobState::Cancelled;
+            job->message = "Cancelled before starting";
+        }
+        sliceStart = {};
+    }
+
+    void cancelAll() {
+        for (auto& job : jobs) cancel(job->id);
+    }
+
+    // Cancel everything, wait for the jobs to close and free the thumbnails
+    // (before the GL context goes away)
+    void destroy() {
+        cancelAll();
+        for (auto& job : jobs) {
+            if (job->state == JobState::Finishing) complete(*job);
+        }
+        for (auto& job : jobs) job->thumbnail.destroy();
+        jobs.clear();
+    }
+
+    void clearFinished() {
+        for (auto& job : jobs) {
+            if (job->finished()) job->thumbnail.destroy();
+        }
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(),
+                                  [](const std::unique_ptr<OfflineJob>& job) { return job->finished(); }),
+                   jobs.end());
+    }
+
+    // A job is queued or rendering (paused jobs do not keep the loop awake)
+    bool busy() const {
+        for (const auto& job : jobs) {
+            if (!job->finished()) return job->state != JobState::Paused;
+        }
+        return false;
+    }
+
+    // Output already claimed by a job that has not written it yet
+    bool claims(const std::string& path) const {
+        for (const auto& job : jobs) {
+            if (!job->finished() && job->outputFile == path) return true;
+        }
+        return false;
+    }
+
+    const std::deque<std::unique_ptr<OfflineJob>>& list() const { return jobs; }
+
+private:
+    OfflineJob* head() {
+        for (auto& job : jobs) {
+            if (!job->finished()) return job.get();
+        }
+        return nullptr;
+    }
+
+    OfflineJob* find(int id) {
+        for (auto& job : jobs) {
+            if (job->id == id) return job.get();
+        }
+        return nullptr;
+    }
+
+    bool startJob(OfflineJob& job, GLuint vao, ProgressReporter* reporter) {
+        std::string error;
+        if (!planOfflineJob(job.settings, allowDownscale, error)) {
+            fail(job, error);
+            return false;
+        }
+        if (!error.empty()) {
+            job.message = error;
+            std::cerr << error << "\n";
+            error.clear();
+        }
+        std::string expanded = expandShaderSource(job.fragSource);
+        if (!buildShaderProgram(expanded, job.program, error)) {
+            job.program = 0;
+            fail(job, error);
+            return false;
+        }
+        int thumbWidth = thumbnailWidth;
+        int thumbHeight = std::max(1, thumbWidth * job.settings.height / std::max(job.settings.width, 1));
+        if (!job.thumbnail.create(thumbWidth, thumbHeight, GL_RGB8, "offline job thumbnail", error)) {
+            fail(job, error);
+            return false;
+        }
+        std::cout << "Starting offline render " << job.id << " (" << job.name << ")...\n";
+        job.renderer = std::make_unique<OfflineRenderer>();
+        if (frameCache.enabled) job.renderer->useFrameCache(&frameCache, expanded);
+        if (!job.renderer->start(job.settings, job.program, vao, job.outputFile, reporter, error)) {
+            fail(job, error);
+            return false;
+        }
+        job.state = JobState::Running;
+        sliceStart = {};
+        return true;
+    }
+
+    // A finishing job's close thread is done (or is waited for)
+    void complete(OfflineJob& job) {
+        std::string error;
+        bool ok = job.renderer->endClose(error);
+        if (job.renderer->wasCancelled()) {
+            job.state = JobState::Cancelled;
+            job.message = error;
+        } else if (ok) {
+            job.state = JobState::Done;
+            job.message = "Saved as " + job.outputFile;
+            int cached = job.renderer->framesFromCache();
+            if (cached > 0) job.message += " (" + std::to_string(cached) + " frames from cache)";
+            int reused = job.renderer->segmentsReused();
+            if (reused > 0) job.message += " (" + std::to_string(reused) + " segments unchanged)";
+        } else {
+            job.state = JobState::Failed;
+            job.message = error;
+            std::cerr << error << "\n";
+        }
+        release(job);
+    }
+
+    void fail(OfflineJob& job, const std::string& error) {
+        std::cerr << error << "\n";
+        job.state = JobState::Failed;
+        job.message = error;
+        release(job);
+    }
+
+    void drawThumbnail(OfflineJob& job, GLuint vao) {
+        int index = std::max(job.renderer->framesDone() - 1, 0);
+        GLint iTimeLoc = glGetUniformLocation(job.program, "iTime");
+        GLint iResLoc = glGetUniformLocation(job.program, "iResolution");
+        glBindFramebuffer(GL_FRAMEBUFFER, job.thumbnail.fbo);
+        glViewport(0, 0, job.thumbnail.width, job.thumbnail.height);
+        glUseProgram(job.program);
+        if (iTimeLoc != -1) glUniform1f(iTimeLoc, job.renderer->timeOfFrame(index));
+        if (iResLoc != -1) {
+            glUniform3f(iResLoc, static_cast<float>(job.thumbnail.width), static_cast<float>(job.thumbnail.height), 1.0f);
+        }
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Drop the GL program and renderer; the thumbnail stays for the panel
+    void release(OfflineJob& job) {
+        job.renderer.reset();
+        if (job.program) glDeleteProgram(job.program);
+        job.program = 0;
+    }
+
+    std::deque<std::unique_ptr<OfflineJob>> jobs;
+    int nextId = 1;
+    std::chrono::steady_clock::time_point sliceStart{};
+    std::chrono::steady_clock::time_point lastThumbnail{};
+};
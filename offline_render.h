@@ -0,0 +1,1107 @@
+#pragma once
+// Offline (video) render pipeline: draws each frame into an off-screen
+// target, reads it back and queues it for the ffmpeg writer.
+//
+// Frames larger than the GL texture/viewport limits, or when a tile size is
+// requested, are drawn as tiles: a tile-sized target is reused, the shader
+// sees global pixel coordinates through iTileOffset (see expandShaderSource)
+// and each tile is read straight into its place in the output frame, so GPU
+// memory stays bounded by the tile size and no single draw runs long enough
+// to trip a driver watchdog.
+//
+// With a strip height set, frames are streamed as horizontal strips instead:
+// each strip is read into one of two pixel pack buffers and, while the next
+// strip draws, the previous one is copied into a strip-sized encoder buffer
+// and queued for the writer. Peak host memory is then a few strips rather
+// than a few frames, and the readback overlaps the remaining draws.
+//
+// With supersampling, each region is drawn at N x N resolution into a larger
+// target (plus an apron for the filter taps) and resolved on the GPU into the
+// output-sized target, so readback and encoding stay at output resolution.
+//
+// Motion blur renders K sub-frame time samples across the shutter interval
+// and adds them (weighted 1/K through the blend color) into a 16-bit
+// accumulation target, which is converted once into the output target: K
+// draws per frame, but a single readback. The target is normalized rather
+// than float so each sub-frame is clamped exactly like a normal frame.
+//
+// With a frame cache (useFrameCache), each frame is looked up by its content
+// key before drawing; a hit is streamed from disk to the encoder and a miss
+// is written to the cache as it is queued.
+//
+// The frames can also be kept in a frame store (see frame_store.h), next to
+// the video or instead of it, for later encodes that skip the shader.
+//
+// Extra sinks (smaller videos, still frames) are filtered down from the
+// master frame on the GPU with the resolve pass, read back once per size and
+// handed to their own encoder pipes, which encode concurrently. They need the
+// whole master frame in one target, so they are only offered untiled.
+#include "encoder.h"
+#include "frame_cache.h"
+#include "gpu_timer.h"
+#include "progress.h"
+#include "render_target.h"
+#include "resolve.h"
+#include "trace.h"
+#include "stb_image_write.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Frames buffered between readback and the ffmpeg writer thread
+const int ENCODER_QUEUE_FRAMES = 2;
+// Tile edge used when a frame exceeds the GL limits and no tile size is set
+const int DEFAULT_TILE_SIZE = 2048;
+// Strip height used when a job is switched to streaming to fit the host budget
+const int DEFAULT_STRIP_HEIGHT = 256;
+// Segment length of incremental renders that do not set one (2 s at 60 fps)
+const int DEFAULT_SEGMENT_FRAMES = 120;
+
+// Where an offline job's frames go
+enum class OfflineOutput { Video, FrameStore, VideoAndFrameStore };
+
+// Extra deliverable of a job, filtered down from the master frame
+struct OfflineSink {
+    enum class Kind { Video, Still };
+    Kind kind = Kind::Video;
+    int width = 1920;
+    int height = 1080;
+    int frame = 0;  // the frame a still is taken from
+};
+
+struct OfflineSettings {
+    int width = 3840;
+    int height = 2160;
+    int totalFrames = 1800;
+    float duration = 30.0f;
+    float slowdown = 1.0f;
+    int tileSize = 0;     // 0 = single draw unless the frame exceeds GL limits
+    int stripHeight = 0;  // 0 = read back and queue whole frames
+    int supersample = 1;  // SSAA factor per axis, 1 = off
+    ResolveFilter resolveFilter = ResolveFilter::Box;
+    int motionBlurSamples = 1;    // sub-frames per output frame, 1 = off
+    float shutterAngle = 180.0f;  // degrees of the frame interval the shutter is open
+    OfflineOutput output = OfflineOutput::Video;
+    bool compressFrameStore = false;  // LZ4 blocks instead of raw frames
+    std::vector<OfflineSink> sinks;    // extra outputs (untiled jobs only)
+    int segmentFrames = 0;             // split the video into segments encoded in parallel (0 = off)
+    int encoderProcesses = 4;          // segment encoders running at once
+    bool incremental = false;          // re-encode only segments that changed since the last render to the output
+};
+
+// File of an extra sink: the output's name plus its size or frame
+inline std::string sinkOutputPath(const std::string& outputFile, const OfflineSink& sink) {
+    std::filesystem::path path(outputFile);
+    std::string stem = path.replace_extension("").string();
+    if (sink.kind == OfflineSink::Kind::Still) return stem + "_frame" + std::to_string(sink.frame) + ".png";
+    return stem + "_" + std::to_string(sink.width) + "x" + std::to_string(sink.height) + ".mp4";
+}
+
+// Frame store written by a job: the output itself, or next to the video
+inline std::string frameStorePath(const OfflineSettings& s, const std::string& outputFile) {
+    if (s.output == OfflineOutput::FrameStore) return outputFile;
+    return std::filesystem::path(outputFile).replace_extension(".gsframes").string();
+}
+
+// Largest square tile edge the context can render and read back
+inline int maxRenderDimension() {
+    GLint maxTexture = 0, maxViewport[2] = {0, 0};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    return std::min(maxTexture, std::min(maxViewport[0], maxViewport[1]));
+}
+
+inline int supersampleFactor(const OfflineSettings& s) { return std::max(s.supersample, 1); }
+
+inline int supersampleApron(const OfflineSettings& s) {
+    int factor = supersampleFactor(s);
+    return factor > 1 ? resolveApron(static_cast<float>(factor), s.resolveFilter) : 0;
+}
+
+// Largest output region one draw can cover once supersampled
+inline int renderLimit(const OfflineSettings& s) {
+    return std::max(1, (maxRenderDimension() - 2 * supersampleApron(s)) / supersampleFactor(s));
+}
+
+// Tile edge the job will actually use (0 = untiled)
+inline int effectiveTileSize(const OfflineSettings& s) {
+    int limit = renderLimit(s);
+    int tile = s.tileSize;
+    if (tile <= 0 && (s.width > limit || s.height > limit)) tile = DEFAULT_TILE_SIZE;
+    if (tile <= 0) return 0;
+    tile = std::min(tile, limit);
+    return (tile >= s.width && tile >= s.height) ? 0 : tile;
+}
+
+// Rows per streamed strip (0 = whole frames)
+inline int effectiveStripHeight(const OfflineSettings& s) {
+    if (s.stripHeight <= 0 || s.stripHeight >= s.height) return 0;
+    return std::min(s.stripHeight, renderLimit(s));
+}
+
+// Size of the off-screen target one draw renders into
+inline void offlineTargetSize(const OfflineSettings& s, int& width, int& height) {
+    int tile = effectiveTileSize(s);
+    int strip = effectiveStripHeight(s);
+    width = tile ? std::min(tile, s.width) : s.width;
+    height = tile ? std::min(tile, s.height) : s.height;
+    if (strip) height = std::min(height, strip);
+}
+
+// Memory the job will allocate on top of what is already tracked
+inline void estimateOfflineJob(const OfflineSettings& s, size_t& gpuBytes, size_t& hostBytes) {
+    int targetWidth, targetHeight;
+    offlineTargetSize(s, targetWidth, targetHeight);
+    int strip = effectiveStripHeight(s);
+    size_t bufferBytes = static_cast<size_t>(s.width) * (strip ? strip : s.height) * 3;
+    gpuBytes = estimateTargetBytes(targetWidth, targetHeight, GL_RGB8) + (strip ? 2 * bufferBytes : 0);
+    int factor = supersampleFactor(s);
+    if (factor > 1) {
+        int apron = supersampleApron(s);
+        gpuBytes += estimateTargetBytes(targetWidth * factor + 2 * apron, targetHeight * factor + 2 * apron, GL_RGB8);
+    }
+    if (s.motionBlurSamples > 1) gpuBytes += estimateTargetBytes(targetWidth, targetHeight, GL_RGBA16);
+    hostBytes = static_cast<size_t>(ENCODER_QUEUE_FRAMES + 1) * bufferBytes;
+    for (const OfflineSink& sink : s.sinks) {
+        size_t sinkBytes = static_cast<size_t>(sink.width) * sink.height * 3;
+        gpuBytes += estimateTargetBytes(sink.width, sink.height, GL_RGB8);
+        hostBytes += sink.kind == OfflineSink::Kind::Video ? (ENCODER_QUEUE_FRAMES + 1) * sinkBytes : sinkBytes;
+    }
+}
+
+// Check an offline job against the memory budgets before anything is
+// allocated. Over the host budget it first switches to strip streaming and
+// over the GPU budget to tiled rendering; if it
+// still does not fit it is refused, or scaled down (keeping the aspect
+// ratio) until it fits when allowDownscale is set.
+inline bool planOfflineJob(OfflineSettings& s, bool allowDownscale, std::string& message) {
+    ResourceRegistry& registry = ResourceRegistry::instance();
+    bool sinks = !s.sinks.empty();
+    if (s.incremental && s.output != OfflineOutput::Video) {
+        message = "Offline render refused: incremental renders write a video only";
+        return false;
+    }
+    if (sinks && (effectiveTileSize(s) != 0 || effectiveStripHeight(s) != 0)) {
+        message = "Offline render refused: extra outputs need the whole frame in one draw (no tiles or strips)";
+        return false;
+    }
+    size_t gpuBytes, hostBytes;
+    estimateOfflineJob(s, gpuBytes, hostBytes);
+    if (registry.fits(gpuBytes, hostBytes, message)) return true;
+    std::string reason = message;
+    if (!sinks && effectiveStripHeight(s) == 0 && !registry.fits(0, hostBytes, message)) {
+        OfflineSettings streamed = s;
+        streamed.stripHeight = DEFAULT_STRIP_HEIGHT;
+        estimateOfflineJob(streamed, gpuBytes, hostBytes);
+        if (effectiveStripHeight(streamed) != 0 && registry.fits(gpuBytes, hostBytes, message)) {
+            message = "Switched offline render to " + std::to_string(DEFAULT_STRIP_HEIGHT) + " row strips (" + reason + ")";
+            s = streamed;
+            return true;
+        }
+    }
+    if (!sinks && effectiveTileSize(s) == 0) {
+        OfflineSettings tiled = s;
+        tiled.tileSize = DEFAULT_TILE_SIZE;
+        estimateOfflineJob(tiled, gpuBytes, hostBytes);
+        if (effectiveTileSize(tiled) != 0 && registry.fits(gpuBytes, hostBytes, message)) {
+            message = "Switched offline render to " + std::to_string(DEFAULT_TILE_SIZE) + " px tiles (" + reason + ")";
+            s = tiled;
+            return true;
+        }
+    }
+    if (!allowDownscale) {
+        message = "Offline render refused: " + reason;
+        return false;
+    }
+    for (double scale = 0.9; scale > 0.05; scale *= 0.9) {
+        OfflineSettings scaled = s;
+        scaled.width = std::max(2, static_cast<int>(s.width * scale) & ~1);
+        scaled.height = std::max(2, static_cast<int>(s.height * scale) & ~1);
+        estimateOfflineJob(scaled, gpuBytes, hostBytes);
+        if ((!sinks || effectiveTileSize(scaled) == 0) && registry.fits(gpuBytes, hostBytes, message)) {
+            message = "Downscaled offline render from " + std::to_string(s.width) + "x" + std::to_string(s.height) +
+                      " to " + std::to_string(scaled.width) + "x" + std::to_string(scaled.height) + " (" + reason + ")";
+            s = scaled;
+            return true;
+        }
+    }
+    message = "Offline render refused even when downscaled: " + reason;
+    return false;
+}
+
+class OfflineRenderer {
+public:
+    // Consult `cache` for every frame; call before start() with the source
+    // the program was compiled from
+    void useFrameCache(FrameCache* cache, const std::string& expandedSource) {
+        frameCache = cache;
+        sourceHash = ContentHash().add(expandedSource).value();
+    }
+
+    bool start(const OfflineSettings& s, GLuint shaderProgram, GLuint quadVAO, const std::string& output,
+               ProgressReporter* reporter, std::string& error) {
+        settings = s;
+        program = shaderProgram;
+        vao = quadVAO;
+        outputFile = output;
+        progress = reporter ? reporter : &consoleOnly;
+        frame = 0;
+        cachedFrames = 0;
+        iTimeLoc = glGetUniformLocation(program, "iTime");
+        iResLoc = glGetUniformLocation(program, "iResolution");
+        iTileOffsetLoc = glGetUniformLocation(program, "iTileOffset");
+        uvTransformLoc = glGetUniformLocation(program, "uvTransform");
+
+        tileSize = effectiveTileSize(settings);
+        stripHeight = effectiveStripHeight(settings);
+        int targetWidth, targetHeight;
+        offlineTargetSize(settings, targetWidth, targetHeight);
+        tiled = targetWidth < settings.width || targetHeight < settings.height;
+        if (!target.create(targetWidth, targetHeight, GL_RGB8, "offline render", error)) return false;
+        factor = supersampleFactor(settings);
+        apron = supersampleApron(settings);
+        if (factor > 1) {
+            if (!resolve.init(error) ||
+                !supersampled.create(targetWidth * factor + 2 * apron, targetHeight * factor + 2 * apron, GL_RGB8,
+                                     "offline supersample", error)) {
+                target.destroy();
+                return false;
+            }
+            std::cout << "Supersampled render: " << factor << "x" << factor << " ("
+                      << settings.width * factor << "x" << settings.height * factor << "), "
+                      << resolveFilterName(settings.resolveFilter) << " resolve\n";
+        }
+        blurSamples = std::max(settings.motionBlurSamples, 1);
+        if (blurSamples > 1) {
+            if (!accumulation.create(targetWidth, targetHeight, GL_RGBA16, "offline motion blur", error)) {
+                supersampled.destroy();
+                resolve.destroy();
+                target.destroy();
+                return false;
+            }
+            std::cout << "Motion blur: " << blurSamples << " sub-frames, " << settings.shutterAngle << " degree shutter\n";
+        }
+
+        size_t bufferBytes = static_cast<size_t>(settings.width) * (stripHeight ? stripHeight : settings.height) * 3;
+        if (stripHeight) {
+            glGenBuffers(2, stripBuffers);
+            for (GLuint buffer : stripBuffers) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+                glBufferData(GL_PIXEL_PACK_BUFFER, bufferBytes, nullptr, GL_STREAM_READ);
+                ResourceRegistry::instance().track(ResourceKind::Buffer, buffer, bufferBytes, "offline render", "strip readback");
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        bool video = settings.output != OfflineOutput::FrameStore;
+        if (settings.output != OfflineOutput::Video &&
+            !store.open(frameStorePath(settings, outputFile), settings.width, settings.height, 60.0f,
+                        settings.compressFrameStore, settings.totalFrames, bufferBytes, error)) {
+            releaseStripBuffers();
+            accumulation.destroy();
+            supersampled.destroy();
+            resolve.destroy();
+            target.destroy();
+            progress->finish(false, error);
+            return false;
+        }
+        bool incremental = settings.output == OfflineOutput::Video && settings.incremental;
+        int segmentFrames = settings.segmentFrames > 0 ? settings.segmentFrames : incremental ? DEFAULT_SEGMENT_FRAMES : 0;
+        bool segmented = video && segmentFrames > 0 && (incremental || settings.totalFrames > segmentFrames);
+        if (segmented && !segments.open(settings.width, settings.height, outputFile, EncodeOptions(), segmentFrames,
+                                        settings.encoderProcesses, frameBytes(), settings.totalFrames, incremental, error)) {
+            store.close(error);
+            releaseStripBuffers();
+            accumulation.destroy();
+            supersampled.destroy();
+            resolve.destroy();
+            target.destroy();
+            progress->finish(false, error);
+            return false;
+        }
+        if (!encoder.open(video && !segmented ? ffmpegCommand(settings.width, settings.height, outputFile) : "", bufferBytes,
+                          ENCODER_QUEUE_FRAMES, error, store.isOpen() ? &store : nullptr,
+                          segmented ? &segments : nullptr)) {
+            segments.close(false, error);
+            store.close(error);
+            releaseStripBuffers();
+            accumulation.destroy();
+            supersampled.destroy();
+            resolve.destroy();
+            target.destroy();
+            progress->finish(false, error);
+            return false;
+        }
+        if (!openSinks(error)) {
+            std::string ignored;
+            encoder.close(ignored);
+            closeStore(ignored);
+            closeSinks(ignored);
+            releaseResources();
+            progress->finish(false, error);
+            return false;
+        }
+        probeSegmentFrames = incremental ? segmentFrames : 0;
+        if (segmented) {
+            std::cout << (incremental ? "Incremental" : "Segment-parallel") << " encoding: " << segmentFrames << " frame segments, up to "
+                      << std::max(settings.encoderProcesses, 1) << " encoders\n";
+        }
+        if (tileSize) {
+            std::cout << "Tiled render: " << tileSize << " px tiles, "
+                      << tilesAcross() * tilesDown() << " tiles per frame\n";
+        }
+        if (stripHeight) {
+            std::cout << "Streaming render: " << stripHeight << " row strips, "
+                      << ResourceRegistry::toMB(bufferBytes) << " MB per strip\n";
+        }
+        if (frameCache) {
+            // Everything but the frame time that decides the pixels
+            jobKey = ContentHash();
+            jobKey.add("offline frame").addValue(sourceHash).addValue(settings.width).addValue(settings.height);
+            jobKey.addValue(factor).addValue(factor > 1 ? static_cast<int>(settings.resolveFilter) : 0);
+            jobKey.addValue(blurSamples).addValue(blurSamples > 1 ? settings.shutterAngle : 0.0f).add("rgb24");
+        }
+        timer.init();
+        history = TimingHistory(settings.totalFrames > 0 ? settings.totalFrames : 1);
+        progress->begin(outputFile, settings.totalFrames, settings.width, settings.height);
+        return true;
+    }
+
+    // Render, read back and queue the rest of the current frame, or the whole
+    // next one; false once every frame is done
+    bool renderNextFrame() {
+        bool more = renderStep(true);
+        while (more && inFrame) more = renderStep(true);
+        return more;
+    }
+
+    // Do the next piece of a frame so a caller sharing the context can stop
+    // in between: a piece of a cached frame, one tile or strip, or an
+    // untiled frame's draw and later its readback. Without `wait` the
+    // readback is left for a later step until the draw's fence has signalled
+    // (see waitingForGpu()), and a step that would block on a full encoder
+    // queue is not started (see waitingForEncoder()). False once every frame
+    // is done.
+    bool renderStep(bool wait = false) {
+        encoderBusy = false;
+        settleCacheFiles(false);
+        if (probeCheckPending) return rewindChangedSegment(wait) || frame < settings.totalFrames;
+        if (!inFrame) {
+            if (frame >= settings.totalFrames) return false;
+            beginFrame();
+        }
+        if (!wait && !encoderHasRoom()) {
+            encoderBusy = true;
+            return true;
+        }
+        TRACE_ZONE("frame step");
+        bindFrameState();
+        bool frameDone = cachedFile ? queueCachedPiece()
+                       : stripHeight ? drawNextStrip()
+                       : tiled ? drawNextTile()
+                       : drawWholeFrame(wait);
+        if (tiled || factor > 1) resetTileUniforms();
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!frameDone) return true;
+        endFrame();
+        return rewindChangedSegment(wait) || frame < settings.totalFrames;
+    }
+
+    // An untiled frame has been drawn and its readback waits for the GPU
+    bool waitingForGpu() const { return drawFence != nullptr; }
+
+    // The last step found the encoder queue too full to take its pieces
+    bool waitingForEncoder() const { return encoderBusy; }
+
+    ~OfflineRenderer() {
+        if (closer.joinable()) closer.join();
+    }
+
+    // Release the GL resources, then drain the encoder, segment pool, frame
+    // store and sinks on a worker thread: ffmpeg exiting and the segment
+    // concat can take seconds. Poll closed(), then collect the result with
+    // endClose(). A cancelled render keeps the frames written so far.
+    void beginClose(bool cancel) {
+        if (!cancel) {
+            std::cout << "Shader GPU time over " << history.size() << " frames: p50 "
+                      << history.percentile(0.50f) << " ms, p95 "
+                      << history.percentile(0.95f) << " ms, p99 "
+                      << history.percentile(0.99f) << " ms\n";
+            if (cachedFrames > 0) {
+                std::cout << cachedFrames << " of " << settings.totalFrames << " frames read from the frame cache\n";
+            }
+        }
+        releaseGlResources();
+        cancelled = cancel;
+        closeDone = false;
+        closer = std::thread([this] {
+            trace::setThreadName("offline close");
+            closeOk = cancelled ? closeCancelled() : closeOutputs(closeError);
+            closeDone = true;
+        });
+    }
+
+    bool closed() const { return closeDone; }
+    bool wasCancelled() const { return cancelled; }
+
+    // Wait for the close started by beginClose(); false with `error` if an
+    // output failed or the render was cancelled
+    bool endClose(std::string& error) {
+        if (closer.joinable()) closer.join();
+        settleCacheFiles(true);
+        for (auto& out : sinkOutputs) {
+            if (!out->pixels.empty()) releaseHostBuffer(out->pixels.data());
+        }
+        sinkOutputs.clear();
+        if (cancelled) {
+            error = "Cancelled after " + std::to_string(frame) + " of " + std::to_string(settings.totalFrames) + " frames";
+            std::cout << error << " (" << outputFile << ")\n";
+            progress->finish(false, error);
+        } else if (closeOk) {
+            std::cout << "Offline render complete. Saved as " << outputFile << "\n";
+            progress->finish(true, outputFile);
+        } else {
+            error = closeError;
+            progress->finish(false, error);
+        }
+        return closeOk;
+    }
+
+    // iTime of a frame index
+    float timeOfFrame(int index) const {
+        return settings.totalFrames > 1
+            ? (index / static_cast<float>(settings.totalFrames - 1)) * settings.duration * settings.slowdown
+            : 0.0f;
+    }
+
+    int framesDone() const { return frame; }
+    int framesFromCache() const { return cachedFrames; }
+    int segmentsReused() const { return reusedSegments; }
+    const OfflineSettings& job() const { return settings; }
+
+private:
+    // Set up the next frame, served from the frame cache when it has it
+    void beginFrame() {
+        frameStart = std::chrono::steady_clock::now();
+        frameTime = timeOfFrame(frame);
+        frameInterval = settings.totalFrames > 1
+            ? settings.duration * settings.slowdown / (settings.totalFrames - 1)
+            : 0.0f;
+        if (frameCache) {
+            ContentHash key = jobKey;
+            key.addValue(frameTime).addValue(blurSamples > 1 ? frameInterval : 0.0f);
+            cacheKey = key.value();
+            cachedFile = frameCache->openFrame(cacheKey, frameBytes());
+            if (!cachedFile) cacheFile = frameCache->createFrame(cacheKey, frameBytes());
+        }
+        inFrame = true;
+        region = 0;
+        pendingRows = 0;
+        frameGpuMs = 0.0;
+    }
+
+    // The preview and the job thumbnails use the context between steps
+    void bindFrameState() {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        glUseProgram(program);
+        if (iTimeLoc != -1) glUniform1f(iTimeLoc, frameTime);
+        if (iResLoc != -1) {
+            glUniform3f(iResLoc, static_cast<float>(settings.width * factor), static_cast<float>(settings.height * factor), 1.0f);
+        }
+        glBindVertexArray(vao);
+    }
+
+    void endFrame() {
+        if (cacheFile) {
+            cacheHandoffs.push_back(CacheHandoff{cacheFile, cacheKey, false, true, frame, lastTicket});
+            cacheFile = nullptr;
+        }
+        if (cachedFile) {
+            cacheHandoffs.push_back(CacheHandoff{cachedFile, cacheKey, true, false, frame, lastTicket});
+            cachedFile = nullptr;
+            cachedFrames++;
+        } else {
+            history.add(frameGpuMs);
+        }
+        inFrame = false;
+        frame++;
+        reportProgress(std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+    }
+
+    // Untiled: draw the frame behind a fence, then read it back once the GPU
+    // has finished it. True when the frame is queued.
+    bool drawWholeFrame(bool wait) {
+        if (!drawFence) {
+            drawRegion(0, 0, settings.width, settings.height);
+            drawFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            if (!wait) return false;
+        }
+        {
+            TRACE_ZONE("draw fence");
+            GLenum status;
+            do {
+                status = glClientWaitSync(drawFence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+            } while (wait && status == GL_TIMEOUT_EXPIRED);
+            if (status == GL_TIMEOUT_EXPIRED) return false;
+        }
+        glDeleteSync(drawFence);
+        drawFence = nullptr;
+        unsigned char* pixels = encoder.acquireBuffer();
+        {
+            TRACE_ZONE("glReadPixels");
+            glReadPixels(0, 0, settings.width, settings.height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        }
+        feedSinks();
+        frameGpuMs += collectTimings(true);
+        lastTicket = encoder.submitBuffer(encoder.bufferSize(), nullptr, cacheFile);
+        return true;
+    }
+
+    // Tiles are read directly into their place in the frame (GL row order)
+    bool drawNextTile() {
+        if (region == 0) framePixels = encoder.acquireBuffer();
+        int tx = region % tilesAcross() * tileSize;
+        int ty = region / tilesAcross() * tileSize;
+        int w = std::min(tileSize, settings.width - tx);
+        int h = std::min(tileSize, settings.height - ty);
+        glPixelStorei(GL_PACK_ROW_LENGTH, settings.width);
+        drawRegion(tx, ty, w, h);
+        {
+            TRACE_ZONE("glReadPixels tile");
+            glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE,
+                         framePixels + (static_cast<size_t>(ty) * settings.width + tx) * 3);
+        }
+        frameGpuMs += collectTimings(false);
+        if (++region < tilesAcross() * tilesDown()) return false;
+        frameGpuMs += collectTimings(true);
+        lastTicket = encoder.submitBuffer(encoder.bufferSize(), nullptr, cacheFile);
+        framePixels = nullptr;
+        return true;
+    }
+
+    // Incremental renders only hash the frames of a segment that may be
+    // unchanged. Once one differs (checked without waiting, and for certain
+    // at the segment's end), the segment is drawn again from its first frame
+    // and encoded; with the frame cache on, those frames are cache hits.
+    // Both need the writer idle; without `wait` the check is retried by the
+    // next step until it is.
+    bool rewindChangedSegment(bool wait) {
+        probeCheckPending = false;
+        if (probeSegmentFrames == 0 || frame == 0) return false;
+        int segment = (frame - 1) / probeSegmentFrames;
+        if (!segments.probes(segment)) return false;
+        bool segmentEnd = frame % probeSegmentFrames == 0 || frame == settings.totalFrames;
+        if (segmentEnd && !encoderDrained(wait)) return true;
+        if (!segments.probeFailed()) return false;
+        if (!encoderDrained(wait)) return true;
+        segments.restartSegment();
+        rewoundFrames += frame - segment * probeSegmentFrames;
+        frame = segment * probeSegmentFrames;
+        return true;
+    }
+
+    bool encoderDrained(bool wait) {
+        if (wait) {
+            encoder.flush();
+            return true;
+        }
+        if (encoder.idle()) return true;
+        probeCheckPending = encoderBusy = true;
+        return false;
+    }
+
+    // Whether the encoders can take every piece the next step queues: one
+    // per tile, untiled or cached frame (plus one per video sink when the
+    // step feeds the sinks), up to two for a strip, which also hands over the
+    // one read the step before
+    bool encoderHasRoom() {
+        int pieces = 0;
+        bool feedsSinks = false;
+        if (cachedFile && sinkOutputs.empty()) {
+            pieces = 1;
+        } else if (cachedFile) {
+            pieces = region == 0 ? 1 : 0;
+            feedsSinks = (region + 1) * kCachedReadBytes >= frameBytes();
+        } else if (stripHeight) {
+            pieces = (pendingRows ? 1 : 0) + (region + 1 == (settings.height + stripHeight - 1) / stripHeight ? 1 : 0);
+        } else if (tiled) {
+            pieces = region == 0 ? 1 : 0;
+        } else {
+            pieces = drawFence ? 1 : 0;
+            feedsSinks = drawFence != nullptr;
+        }
+        if (pieces > 0 && encoder.freeBuffers() < pieces) return false;
+        if (!feedsSinks || frame < sinkFrames) return true;
+        for (auto& out : sinkOutputs) {
+            if (out->encoder && out->encoder->freeBuffers() == 0) return false;
+        }
+        return true;
+    }
+
+    // Index the frame store; a store-only job reports its errors here
+    bool closeStore(std::string& error) {
+        if (!store.isOpen()) return true;
+        std::string storeError;
+        if (!store.close(storeError)) {
+            error = storeError;
+            return false;
+        }
+        std::cout << "Frame store " << store.path() << ": " << store.frames() << " frames";
+        if (settings.compressFrameStore) std::cout << ", LZ4 " << static_cast<int>(store.ratio() * 100.0 + 0.5) << "% of raw";
+        std::cout << "\n";
+        return true;
+    }
+
+    struct SinkOutput {
+        OfflineSink sink;
+        std::string path;
+        RenderTarget target;
+        std::unique_ptr<EncoderPipe> encoder;  // videos
+        std::vector<unsigned char> pixels;     // stills
+        std::thread writer;                    // PNG encoding of a still
+        bool written = true;
+    };
+
+    bool openSinks(std::string& error) {
+        for (const OfflineSink& sink : settings.sinks) {
+            auto out = std::make_unique<SinkOutput>();
+            out->sink = sink;
+            out->sink.frame = std::min(std::max(sink.frame, 0), std::max(settings.totalFrames - 1, 0));
+            out->path = sinkOutputPath(outputFile, out->sink);
+            size_t bytes = static_cast<size_t>(sink.width) * sink.height * 3;
+            if (!out->target.create(sink.width, sink.height, GL_RGB8, "offline sink", error)) return false;
+            if (sink.kind == OfflineSink::Kind::Video) {
+                out->encoder = std::make_unique<EncoderPipe>();
+                if (!out->encoder->open(ffmpegCommand(sink.width, sink.height, out->path), bytes, ENCODER_QUEUE_FRAMES, error)) {
+                    out->target.destroy();
+                    return false;
+                }
+            } else {
+                out->pixels.resize(bytes);
+                trackHostBuffer(out->pixels.data(), bytes, "offline sink", "still readback");
+            }
+            std::cout << "Extra output: " << out->path << " (" << sink.width << "x" << sink.height << ")\n";
+            sinkOutputs.push_back(std::move(out));
+        }
+        return sinkOutputs.empty() || resolve.init(error);
+    }
+
+    // Filter the master frame in `target` down to every sink that takes this
+    // frame, then read each one back into its encoder or still buffer. All
+    // resolves are queued before the first readback waits on them.
+    void feedSinks() {
+        if (sinkOutputs.empty() || frame < sinkFrames) return;
+        sinkFrames = frame + 1;
+        TRACE_ZONE("sinks");
+        std::vector<SinkOutput*> active;
+        glBindVertexArray(vao);
+        for (auto& out : sinkOutputs) {
+            if (out->sink.kind == OfflineSink::Kind::Still && out->sink.frame != frame) continue;
+            glBindFramebuffer(GL_FRAMEBUFFER, out->target.fbo);
+            glViewport(0, 0, out->target.width, out->target.height);
+            resolve.apply(target.texture, 0, 0, settings.width, settings.height,
+                          settings.width / static_cast<float>(out->target.width),
+                          settings.height / static_cast<float>(out->target.height), 0, 0, ResolveFilter::Lanczos);
+            active.push_back(out.get());
+        }
+        for (SinkOutput* out : active) {
+            glBindFramebuffer(GL_FRAMEBUFFER, out->target.fbo);
+            int w = out->target.width, h = out->target.height;
+            if (out->encoder) {
+                TRACE_ZONE("glReadPixels sink");
+                glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, out->encoder->acquireBuffer());
+                out->encoder->submitBuffer(out->encoder->bufferSize());
+            } else {
+                glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, out->pixels.data());
+                out->writer = std::thread([out, w, h] {
+                    // Rows are bottom-up: start at the last one with a negative stride
+                    out->written = stbi_write_png(out->path.c_str(), w, h, 3, out->pixels.data() + static_cast<size_t>(h - 1) * w * 3,
+                                                  -w * 3) != 0;
+                });
+            }
+        }
+        glUseProgram(program);
+        glBindVertexArray(vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    }
+
+    // Drain the sink encoders and still writers; false if any output failed
+    bool closeSinks(std::string& error) {
+        bool ok = true;
+        for (auto& out : sinkOutputs) {
+            std::string sinkError;
+            if (out->encoder && !out->encoder->close(sinkError)) {
+                error = out->path + ": " + sinkError;
+                ok = false;
+            }
+            if (out->writer.joinable()) out->writer.join();
+            if (!out->written) {
+                error = "Failed to write " + out->path;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    // Drain the encoder and its consumers (on the close thread); false with
+    // the first error
+    bool closeOutputs(std::string& error) {
+        bool ok = encoder.close(error);
+        std::string segmentError, storeError, sinkError;
+        if (!segments.close(ok, segmentError)) {
+            if (ok) error = segmentError;
+            ok = false;
+        }
+        reusedSegments = segments.reusedSegments();
+        if (ok && probeSegmentFrames > 0) {
+            std::cout << "Re-encoded " << segments.segments() - reusedSegments << " of " << segments.segments()
+                      << " segments (" << rewoundFrames << " frames drawn twice)\n";
+        }
+        if (!closeStore(storeError)) {
+            if (ok) error = storeError;
+            ok = false;
+        }
+        if (!closeSinks(sinkError)) {
+            if (ok) error = sinkError;
+            ok = false;
+        }
+        return ok;
+    }
+
+    // Close the outputs on the frames written so far (on the close thread)
+    bool closeCancelled() {
+        std::string ignored;
+        encoder.close(ignored);
+        segments.close(!settings.incremental, ignored);
+        closeStore(ignored);
+        closeSinks(ignored);
+        return false;
+    }
+
+    void releaseResources() {
+        std::string ignored;
+        closeSinks(ignored);
+        for (auto& out : sinkOutputs) {
+            if (!out->pixels.empty()) releaseHostBuffer(out->pixels.data());
+        }
+        releaseGlResources();
+        settleCacheFiles(true);
+        sinkOutputs.clear();
+    }
+
+    // Everything but the encoders and still writers, which may still be
+    // draining
+    void releaseGlResources() {
+        for (auto& out : sinkOutputs) out->target.destroy();
+        // The writer may still use them; settleCacheFiles() closes them
+        if (cacheFile) cacheHandoffs.push_back(CacheHandoff{cacheFile, cacheKey, false, false, frame, lastTicket});
+        cacheFile = nullptr;
+        if (cachedFile) cacheHandoffs.push_back(CacheHandoff{cachedFile, cacheKey, true, false, frame, lastTicket});
+        cachedFile = nullptr;
+        if (drawFence) glDeleteSync(drawFence);
+        drawFence = nullptr;
+        timer.destroy();
+        releaseStripBuffers();
+        accumulation.destroy();
+        supersampled.destroy();
+        resolve.destroy();
+        target.destroy();
+    }
+
+    size_t frameBytes() const { return static_cast<size_t>(settings.width) * settings.height * 3; }
+
+    // Queue the next buffer-sized piece of a cached frame, which the
+    // encoder's writer reads from the file; true once it is all queued. With
+    // sinks the frame is filtered from on the GPU, so it is read here
+    // instead, kCachedReadBytes per step (sinks imply whole frames, so the
+    // buffer holds all of it).
+    bool queueCachedPiece() {
+        TRACE_ZONE("cached frame");
+        if (sinkOutputs.empty()) {
+            size_t offset = static_cast<size_t>(region++) * encoder.bufferSize();
+            size_t bytes = std::min(frameBytes() - offset, encoder.bufferSize());
+            encoder.acquireBuffer();
+            lastTicket = encoder.submitBuffer(bytes, cachedFile);
+            return offset + bytes == frameBytes();
+        }
+        if (region == 0) framePixels = encoder.acquireBuffer();
+        size_t offset = static_cast<size_t>(region++) * kCachedReadBytes;
+        size_t bytes = std::min(frameBytes() - offset, kCachedReadBytes);
+        size_t got = fread(framePixels + offset, 1, bytes, cachedFile);
+        if (got < bytes) memset(framePixels + offset + got, 0, bytes - got);
+        if (offset + bytes < frameBytes()) return false;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, target.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, settings.width, settings.height, GL_RGB, GL_UNSIGNED_BYTE, framePixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        feedSinks();
+        lastTicket = encoder.submitBuffer(frameBytes());
+        framePixels = nullptr;
+        return true;
+    }
+
+    // Close the cache files the writer is done with, in order: publish the
+    // frames written to the cache and report truncated cache hits. With
+    // `all` the encoder must already be closed.
+    void settleCacheFiles(bool all) {
+        while (!cacheHandoffs.empty() && (all || encoder.done(cacheHandoffs.front().ticket))) {
+            const CacheHandoff& handoff = cacheHandoffs.front();
+            if (handoff.hit) {
+                if (feof(handoff.file) || ferror(handoff.file)) {
+                    std::cerr << "Cached frame " << handoff.frame << " was truncated; encoded as black\n";
+                }
+                fclose(handoff.file);
+            } else {
+                frameCache->commitFrame(handoff.file, handoff.key, handoff.keep);
+            }
+            cacheHandoffs.pop_front();
+        }
+    }
+
+    int tilesAcross() const { return (settings.width + tileSize - 1) / tileSize; }
+    int tilesDown() const { return (settings.height + tileSize - 1) / tileSize; }
+
+    // Draw, read and queue one strip per step, bottom-up so the byte stream
+    // matches a whole-frame glReadPixels. Strip k is read into a pack buffer
+    // while strip k-1, read the step before, is mapped and copied to the
+    // encoder. True when the frame is queued.
+    bool drawNextStrip() {
+        int strip = region;
+        int sy = strip * stripHeight;
+        int rows = std::min(stripHeight, settings.height - sy);
+        int regionWidth = target.width;
+        glPixelStorei(GL_PACK_ROW_LENGTH, settings.width);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, stripBuffers[strip % 2]);
+        for (int ty = sy; ty < sy + rows; ty += target.height) {
+            for (int tx = 0; tx < settings.width; tx += regionWidth) {
+                int w = std::min(regionWidth, settings.width - tx);
+                int h = std::min(target.height, sy + rows - ty);
+                drawRegion(tx, ty, w, h);
+                TRACE_ZONE("glReadPixels strip");
+                size_t offset = (static_cast<size_t>(ty - sy) * settings.width + tx) * 3;
+                glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(offset));
+                frameGpuMs += collectTimings(false);
+            }
+        }
+        if (pendingRows) queueStrip(stripBuffers[(strip + 1) % 2], pendingRows);
+        pendingRows = rows;
+        bool last = ++region == (settings.height + stripHeight - 1) / stripHeight;
+        if (last) {
+            queueStrip(stripBuffers[strip % 2], pendingRows);
+            frameGpuMs += collectTimings(true);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return last;
+    }
+
+    // Map a filled pack buffer and hand its rows to the encoder
+    void queueStrip(GLuint buffer, int rows) {
+        TRACE_ZONE("queue strip");
+        size_t bytes = static_cast<size_t>(settings.width) * rows * 3;
+        unsigned char* out = encoder.acquireBuffer();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        if (mapped) {
+            memcpy(out, mapped, bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            memset(out, 0, bytes);
+        }
+        lastTicket = encoder.submitBuffer(bytes, nullptr, cacheFile);
+    }
+
+    void releaseStripBuffers() {
+        if (!stripBuffers[0]) return;
+        for (GLuint buffer : stripBuffers) ResourceRegistry::instance().release(ResourceKind::Buffer, buffer);
+        glDeleteBuffers(2, stripBuffers);
+        stripBuffers[0] = stripBuffers[1] = 0;
+    }
+
+    // Sum the finished timer queries; wait=true drains every one in flight
+    double collectTimings(bool wait) {
+        double total = 0.0, ms = 0.0;
+        while (timer.poll(ms, wait)) total += ms;
+        return total;
+    }
+
+    // Draw the image region [x, x+w) x [y, y+h) (GL pixel coordinates) into
+    // the target's lower-left corner; its GPU time is picked up by collectTimings()
+    void drawRegion(int x, int y, int w, int h) {
+        TRACE_ZONE("draw");
+        timer.begin();
+        if (blurSamples > 1) {
+            // Average the sub-frames at 16 bits, then convert once into the output target
+            glBindFramebuffer(GL_FRAMEBUFFER, accumulation.fbo);
+            glViewport(0, 0, w, h);
+            glClear(GL_COLOR_BUFFER_BIT);
+            float weight = 1.0f / blurSamples;
+            float shutter = frameInterval * settings.shutterAngle / 360.0f;
+            glBlendColor(weight, weight, weight, weight);
+            glBlendFunc(GL_CONSTANT_COLOR, GL_ONE);
+            for (int k = 0; k < blurSamples; ++k) {
+                // Sub-frames are centred on the frame time
+                float t = frameTime + shutter * ((k + 0.5f) / blurSamples - 0.5f);
+                if (iTimeLoc != -1) glUniform1f(iTimeLoc, t);
+                renderRegion(x, y, w, h, accumulation.fbo, true);
+            }
+            if (iTimeLoc != -1) glUniform1f(iTimeLoc, frameTime);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, accumulation.fbo);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+            glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        } else {
+            renderRegion(x, y, w, h, target.fbo, false);
+        }
+        // Submit each tile separately so no single command buffer runs too long
+        if (tiled) glFlush();
+        timer.end();
+    }
+
+    // Draw the region into `fbo`, through the supersampled target and resolve
+    // pass when SSAA is on; accumulate blends it onto what is already there
+    void renderRegion(int x, int y, int w, int h, GLuint fbo, bool accumulate) {
+        if (factor > 1) {
+            // Render the region and its apron at N x N, then filter it down
+            int sx = x * factor - apron, sy = y * factor - apron;
+            glBindFramebuffer(GL_FRAMEBUFFER, supersampled.fbo);
+            drawShader(sx, sy, w * factor + 2 * apron, h * factor + 2 * apron, true, true);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glViewport(0, 0, w, h);
+            if (accumulate) glEnable(GL_BLEND);
+            resolve.apply(supersampled.texture, sx, sy, settings.width * factor, settings.height * factor,
+                          static_cast<float>(factor), static_cast<float>(factor), x, y, settings.resolveFilter);
+            glUseProgram(program);
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            if (accumulate) glEnable(GL_BLEND);
+            drawShader(x, y, w, h, tiled, !accumulate);
+        }
+        if (accumulate) glDisable(GL_BLEND);
+    }
+
+    // Run the shader over [x, x+w) x [y, y+h) of the (supersampled) image
+    void drawShader(int x, int y, int w, int h, bool offset, bool clear) {
+        glViewport(0, 0, w, h);
+        if (offset) {
+            float fullWidth = static_cast<float>(settings.width * factor);
+            float fullHeight = static_cast<float>(settings.height * factor);
+            if (iTileOffsetLoc != -1) glUniform2f(iTileOffsetLoc, static_cast<float>(x), static_cast<float>(y));
+            if (uvTransformLoc != -1) {
+                glUniform4f(uvTransformLoc, x / fullWidth, y / fullHeight, w / fullWidth, h / fullHeight);
+            }
+        }
+        if (clear) glClear(GL_COLOR_BUFFER_BIT);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    void resetTileUniforms() {
+        if (iTileOffsetLoc != -1) glUniform2f(iTileOffsetLoc, 0.0f, 0.0f);
+        if (uvTransformLoc != -1) glUniform4f(uvTransformLoc, 0.0f, 0.0f, 1.0f, 1.0f);
+    }
+
+    void reportProgress(double frameSeconds) {
+        ProgressSample sample;
+        sample.framesDone = frame;
+        sample.totalFrames = settings.totalFrames;
+        sample.frameSeconds = frameSeconds;
+        sample.queueDepth = encoder.queueDepth();
+        sample.queueCapacity = encoder.queueCapacity();
+        sample.encoderBlockedMs = encoder.blockedMs();
+        char metricsJson[256];
+        snprintf(metricsJson, sizeof(metricsJson),
+                 "\"shader_ms\":%.3f,\"shader_ms_p50\":%.3f,\"shader_ms_p95\":%.3f,\"shader_ms_p99\":%.3f,"
+                 "\"gpu_mem_mb\":%.1f,\"host_mem_mb\":%.1f",
+                 history.latest(), history.percentile(0.50f), history.percentile(0.95f), history.percentile(0.99f),
+                 ResourceRegistry::toMB(ResourceRegistry::instance().gpuBytes()),
+                 ResourceRegistry::toMB(ResourceRegistry::instance().hostBytes()));
+        if (progress->update(sample, metricsJson)) {
+            std::cout << "Rendered frame " << frame << " of " << settings.totalFrames
+                      << " | " << progress->fpsSmoothed() << " fps, ETA " << static_cast<int>(progress->etaSeconds()) << " s"
+                      << " | shader " << history.latest() << " ms"
+                      << " (p50 " << history.percentile(0.50f)
+                      << ", p95 " << history.percentile(0.95f)
+                      << ", p99 " << history.percentile(0.99f) << ")\n";
+        }
+    }
+
+    OfflineSettings settings;
+    GLuint program = 0;
+    GLuint vao = 0;
+    GLint iTimeLoc = -1;
+    GLint iResLoc = -1;
+    GLint iTileOffsetLoc = -1;
+    GLint uvTransformLoc = -1;
+    std::string outputFile;
+    ProgressReporter* progress = nullptr;
+    ProgressReporter consoleOnly;  // paces console output when no channel is given
+    RenderTarget target;
+    int tileSize = 0;
+    int stripHeight = 0;
+    bool tiled = false;  // target smaller than the frame
+    int factor = 1;      // supersampling per axis
+    int apron = 0;       // extra supersampled pixels around each region for the resolve filter
+    RenderTarget supersampled;
+    ResolvePass resolve;
+    int blurSamples = 1;
+    float frameTime = 0.0f;      // iTime of the frame being drawn
+    float frameInterval = 0.0f;  // iTime between consecutive frames
+    RenderTarget accumulation;   // weighted sum of the motion blur sub-frames
+    GLuint stripBuffers[2] = {0, 0};
+    FrameStoreWriter store;  // declared before the encoder, whose writer thread feeds it
+    SegmentPool segments;    // likewise
+    EncoderPipe encoder;
+    GpuTimer timer{16};  // several regions per frame can be in flight
+    TimingHistory history;
+    int frame = 0;
+    // The frame being drawn, kept between renderStep() calls
+    bool inFrame = false;
+    int region = 0;                        // next tile or strip
+    int pendingRows = 0;                   // rows of the last strip, still in its pack buffer
+    unsigned char* framePixels = nullptr;  // encoder buffer the tiles are read into
+    GLsync drawFence = nullptr;            // untiled draw waiting to be read back
+    bool encoderBusy = false;              // last step found the encoder queue full
+    bool probeCheckPending = false;        // segment check waits for the writer to go idle
+    double frameGpuMs = 0.0;
+    std::chrono::steady_clock::time_point frameStart;
+    FrameCache* frameCache = nullptr;
+    uint64_t sourceHash = 0;
+    ContentHash jobKey;         // settings part of every frame key
+    uint64_t cacheKey = 0;      // key of the frame being drawn
+    FILE* cacheFile = nullptr;  // its cache file while it is written
+    FILE* cachedFile = nullptr; // cache file the frame is read from instead
+    // Cache files of queued frames, closed once the writer is done with them
+    struct CacheHandoff {
+        FILE* file;
+        uint64_t key;
+        bool hit;        // read for a cache hit, else written
+        bool keep;       // publish the written frame (false if cut short)
+        int frame;
+        long long ticket;  // last buffer of the frame
+    };
+    std::deque<CacheHandoff> cacheHandoffs;
+    long long lastTicket = 0;  // of the last buffer submitted to the encoder
+    static constexpr size_t kCachedReadBytes = 4 << 20;  // per step, see queueCachedPiece()
+    int cachedFrames = 0;       // frames read from the cache instead of drawn
+    int reusedSegments = 0;     // segments kept from the previous incremental render
+    int probeSegmentFrames = 0; // segment length of an incremental render, else 0
+    int rewoundFrames = 0;      // frames drawn again after their segment turned out changed
+    int sinkFrames = 0;         // frames fed to the extra outputs (they skip redrawn frames)
+    std::vector<std::unique_ptr<SinkOutput>> sinkOutputs;
+    // Closing, see beginClose()
+    std::thread closer;
+    std::atomic<bool> closeDone{false};
+    bool cancelled = false;
+    bool closeOk = false;
+    std::string closeError;
+};
@@ -0,0 +1,345 @@
+#pragma once
+// Interactive preview helpers: the shader is drawn into pooled off-screen
+// targets and scaled to the window, so its resolution is independent of the
+// window and can change without reallocating, and the main loop only redraws
+// when needed.
+#include "render_target.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Picks the preview render scale that holds a GPU time budget. Shader cost
+// is roughly proportional to pixel count, so the scale moves towards
+// sqrt(target / measured) of its current value; small errors are ignored
+// and the step is damped, because timer results arrive a few frames late.
+class DynamicResolution {
+public:
+    bool enabled = true;
+    float targetMs = 12.0f;
+    float minScale = 0.25f;
+
+    float scale() const { return enabled ? current : 1.0f; }
+
+    // Feed one measured shader GPU time, taken at (roughly) the current scale
+    void update(double gpuMs) {
+        if (!enabled || gpuMs <= 0.0) return;
+        double error = targetMs / gpuMs;
+        if (error > 0.9 && error < 1.1) return;
+        double ideal = current * std::sqrt(error);
+        double next = current + kGain * (ideal - current);
+        current = static_cast<float>(std::clamp(next, static_cast<double>(minScale), 1.0));
+    }
+
+    void reset() { current = 1.0f; }
+
+    // Render size for a full-size width/height, kept even and non-zero
+    void renderSize(int fullWidth, int fullHeight, int& width, int& height) const {
+        float s = scale();
+        width = std::clamp(static_cast<int>(fullWidth * s) & ~1, 2, fullWidth);
+        height = std::clamp(static_cast<int>(fullHeight * s) & ~1, 2, fullHeight);
+    }
+
+private:
+    static constexpr double kGain = 0.35;
+    float current = 1.0f;
+};
+
+// Largest rectangle with the image's aspect ratio centred in the window
+inline void fitPreviewRect(int width, int height, int windowWidth, int windowHeight, int& x, int& y, int& w, int& h) {
+    double scale = std::min(static_cast<double>(windowWidth) / width, static_cast<double>(windowHeight) / height);
+    w = std::max(1, static_cast<int>(width * scale + 0.5));
+    h = std::max(1, static_cast<int>(height * scale + 0.5));
+    x = (windowWidth - w) / 2;
+    y = (windowHeight - h) / 2;
+}
+
+// Scale the lower-left width x height of a target into the window,
+// letterboxed when the aspect ratios differ
+inline void presentPreview(const RenderTarget* target, int width, int height, int windowWidth, int windowHeight) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (!target || width <= 0 || height <= 0) return;
+    int x, y, w, h;
+    fitPreviewRect(width, height, windowWidth, windowHeight, x, y, w, h);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target->fbo);
+    glBlitFramebuffer(0, 0, width, height, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT,
+                      width == w && height == h ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Halton low-discrepancy sequence in [0, 1)
+inline float halton(int index, int base) {
+    float result = 0.0f, fraction = 1.0f;
+    for (int i = index; i > 0; i /= base) {
+        fraction /= base;
+        result += fraction * (i % base);
+    }
+    return result;
+}
+
+// Progressive supersampling of a paused preview: each call renders the frame
+// once more at full resolution with a sub-pixel jitter (through the
+// iTileOffset/uvTransform uniforms the shader rewrite provides) and folds it
+// into a running average, until maxSamples have been taken. The average is
+// kept in a 16-bit normalized target so every sample is clamped like a
+// normally displayed frame.
+class ProgressiveRefiner {
+public:
+    bool enabled = true;
+    int maxSamples = 64;
+
+    explicit ProgressiveRefiner(RenderTargetPool& targetPool) : pool(targetPool) {}
+    ~ProgressiveRefiner() { destroy(); }
+
+    void reset() { count = 0; }
+    int samples() const { return count; }
+    bool converged() const { return count >= maxSamples; }
+
+    bool addSample(GLuint program, GLuint vao, float time, int width, int height, std::string& error) {
+        if (!target || width != targetWidth || height != targetHeight) {
+            destroy();
+            target = pool.acquire(width, height, GL_RGBA16, "preview refinement", error);
+            if (!target) return false;
+            targetWidth = width;
+            targetHeight = height;
+        }
+        float jx = halton(count + 1, 2) - 0.5f, jy = halton(count + 1, 3) - 0.5f;
+        GLint iTimeLoc = glGetUniformLocation(program, "iTime");
+        GLint iResLoc = glGetUniformLocation(program, "iResolution");
+        GLint offsetLoc = glGetUniformLocation(program, "iTileOffset");
+        GLint uvLoc = glGetUniformLocation(program, "uvTransform");
+        glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+        glViewport(0, 0, width, height);
+        glUseProgram(program);
+        if (iTimeLoc != -1) glUniform1f(iTimeLoc, time);
+        if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(width), static_cast<float>(height), 1.0f);
+        if (offsetLoc != -1) glUniform2f(offsetLoc, jx, jy);
+        if (uvLoc != -1) glUniform4f(uvLoc, jx / width, jy / height, 1.0f, 1.0f);
+        // Running average: new = old * (1 - 1/n) + sample / n
+        glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (count + 1));
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+        glEnable(GL_BLEND);
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        if (offsetLoc != -1) glUniform2f(offsetLoc, 0.0f, 0.0f);
+        if (uvLoc != -1) glUniform4f(uvLoc, 0.0f, 0.0f, 1.0f, 1.0f);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        count++;
+        return true;
+    }
+
+    void present(int windowWidth, int windowHeight) const {
+        presentPreview(target, targetWidth, targetHeight, windowWidth, windowHeight);
+    }
+
+    // Hand the target back to the pool
+    void destroy() {
+        if (target) pool.release(target);
+        target = nullptr;
+        count = 0;
+    }
+
+private:
+    RenderTargetPool& pool;
+    RenderTarget* target = nullptr;
+    int targetWidth = 0;
+    int targetHeight = 0;
+    int count = 0;
+};
+
+// Time-sliced preview for shaders too heavy to draw in one UI frame: each
+// call draws a bounded number of scissored tiles of the frame in progress,
+// and the last completed frame is shown meanwhile, so input latency is
+// bounded by the tile budget rather than by the shader's full-frame cost.
+class TimeSlicedPreview {
+public:
+    bool enabled = false;
+    int tileSize = 256;
+    int tilesPerFrame = 4;
+
+    explicit TimeSlicedPreview(RenderTargetPool& targetPool) : pool(targetPool) {}
+    ~TimeSlicedPreview() { destroy(); }
+
+    // Draw the next tiles, starting a new frame at `time` if none is in
+    // progress; returns true when this call completed a frame
+    bool step(GLuint program, GLuint vao, float time, int width, int height, std::string& error) {
+        if (!targets[0] || width != frameWidth || height != frameHeight) {
+            destroy();
+            for (int i = 0; i < 2; ++i) {
+                targets[i] = pool.acquire(width, height, GL_RGB8, "time-sliced preview", error);
+                if (!targets[i]) {
+                    destroy();
+                    return false;
+                }
+            }
+            frameWidth = width;
+            frameHeight = height;
+        }
+        if (nextTile == 0) frameTime = time;
+        int cols = (width + tileSize - 1) / tileSize;
+        int rows = (height + tileSize - 1) / tileSize;
+        int total = cols * rows;
+        glBindFramebuffer(GL_FRAMEBUFFER, targets[1 - shown]->fbo);
+        glViewport(0, 0, width, height);
+        glUseProgram(program);
+        GLint iTimeLoc = glGetUniformLocation(program, "iTime");
+        GLint iResLoc = glGetUniformLocation(program, "iResolution");
+        if (iTimeLoc != -1) glUniform1f(iTimeLoc, frameTime);
+        if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(width), static_cast<float>(height), 1.0f);
+        glBindVertexArray(vao);
+        glEnable(GL_SCISSOR_TEST);
+        for (int drawn = 0; drawn < tilesPerFrame && nextTile < total; ++drawn, ++nextTile) {
+            // Top row first, so a partial first frame fills in like a page
+            int col = nextTile % cols, row = nextTile / cols;
+            int x = col * tileSize;
+            int top = height - row * tileSize;
+            int h = std::min(tileSize, top);
+            glScissor(x, top - h, std::min(tileSize, width - x), h);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            // Submit each tile on its own so the driver never queues a whole frame
+            glFlush();
+        }
+        glDisable(GL_SCISSOR_TEST);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (nextTile < total) return false;
+        shown = 1 - shown;
+        shownTime = frameTime;
+        completed = true;
+        nextTile = 0;
+        return true;
+    }
+
+    // Drop the frame in progress (shader or time changed)
+    void restart() { nextTile = 0; }
+
+    bool inProgress() const { return nextTile > 0; }
+    bool hasFrame() const { return completed; }
+    float frameShownTime() const { return shownTime; }
+
+    float progress() const {
+        if (!targets[0]) return 0.0f;
+        int cols = (frameWidth + tileSize - 1) / tileSize;
+        int rows = (frameHeight + tileSize - 1) / tileSize;
+        return static_cast<float>(nextTile) / (cols * rows);
+    }
+
+    // Show the last completed frame (the partial one before the first completes)
+    void present(int windowWidth, int windowHeight) const {
+        presentPreview(completed ? targets[shown] : targets[1 - shown], frameWidth, frameHeight, windowWidth, windowHeight);
+    }
+
+    // Hand the targets back to the pool
+    void destroy() {
+        for (RenderTarget*& target : targets) {
+            if (target) pool.release(target);
+            target = nullptr;
+        }
+        nextTile = 0;
+        completed = false;
+    }
+
+private:
+    RenderTargetPool& pool;
+    RenderTarget* targets[2] = {nullptr, nullptr};
+    int frameWidth = 0;
+    int frameHeight = 0;
+    int shown = 0;
+    int nextTile = 0;
+    bool completed = false;
+    float frameTime = 0.0f;
+    float shownTime = 0.0f;
+};
+
+// Preview time (the shader's iTime) with pause and single-step
+class PreviewClock {
+public:
+    explicit PreviewClock(double wallTime = 0.0) : start(wallTime) {}
+
+    double time(double wallTime) const { return paused ? pausedAt : wallTime - start; }
+    bool isPaused() const { return paused; }
+
+    void setPaused(bool pause, double wallTime) {
+        if (pause == paused) return;
+        if (pause) pausedAt = wallTime - start;
+        else start = wallTime - pausedAt;
+        paused = pause;
+    }
+
+    // Advance a paused clock by one step
+    void step(double seconds) {
+        if (paused) pausedAt = std::max(0.0, pausedAt + seconds);
+    }
+
+    // Jump to `seconds`, keeping the paused/running state
+    void seek(double seconds, double wallTime) {
+        if (paused) pausedAt = std::max(0.0, seconds);
+        else start = wallTime - std::max(0.0, seconds);
+    }
+
+    void restart(double wallTime) {
+        start = wallTime;
+        pausedAt = 0.0;
+    }
+
+private:
+    double start;
+    double pausedAt = 0.0;
+    bool paused = false;
+};
+
+// Decides when the main loop draws its next frame. While something animates
+// frames are paced by vsync and the optional cap (a lower rate when the
+// window is unfocused); otherwise, in on-demand mode, the loop sleeps in
+// glfwWaitEventsTimeout until input arrives, then draws a few frames so
+// ImGui can settle hover/active state.
+class FramePacer {
+public:
+    bool vsync = true;
+    int frameCap = 0;         // fps, 0 = uncapped
+    int unfocusedCap = 10;    // fps while another window has focus
+    bool onDemand = true;     // sleep when nothing animates
+    double heartbeat = 1.0;   // seconds between idle redraws (stats, timers)
+
+    // Apply the swap interval when it changed; call with the context current
+    void applyVsync() {
+        if (appliedVsync == static_cast<int>(vsync)) return;
+        glfwSwapInterval(vsync ? 1 : 0);
+        appliedVsync = vsync ? 1 : 0;
+    }
+
+    // Process events, blocking until the next frame is due
+    void waitForFrame(GLFWwindow* window, bool animating) {
+        bool focused = glfwGetWindowAttrib(window, GLFW_FOCUSED) != 0;
+        if (!animating && onDemand && settleFrames <= 0) {
+            double before = glfwGetTime();
+            glfwWaitEventsTimeout(heartbeat);
+            if (glfwGetTime() - before < heartbeat) settleFrames = kSettleFrames;
+        } else {
+            int cap = focused ? frameCap : (frameCap > 0 ? std::min(frameCap, unfocusedCap) : unfocusedCap);
+            double due = lastFrame + (cap > 0 ? 1.0 / cap : 0.0);
+            double remaining = due - glfwGetTime();
+            if (remaining > 0.0) {
+                while (remaining > 0.0) {
+                    glfwWaitEventsTimeout(remaining);
+                    remaining = due - glfwGetTime();
+                }
+            } else {
+                glfwPollEvents();
+            }
+            if (settleFrames > 0) settleFrames--;
+        }
+        lastFrame = glfwGetTime();
+    }
+
+private:
+    static const int kSettleFrames = 3;
+    int appliedVsync = -1;
+    int settleFrames = kSettleFrames;
+    double lastFrame = 0.0;
+};
@@ -0,0 +1,248 @@
+#pragma once
+// Machine-readable progress for offline renders: one JSON object per line on
+// an inherited file descriptor or a Unix domain socket. Updates are rate
+// limited and writes never block the render; if the reader falls behind,
+// lines are dropped and the drop count is reported in the next line. A line
+// the channel took only part of is finished before any later line is sent.
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct ProgressSample {
+    int framesDone = 0;
+    int totalFrames = 0;
+    double frameSeconds = 0.0;     // wall time of the last frame
+    int queueDepth = 0;            // frames waiting for the encoder
+    int queueCapacity = 0;
+    double encoderBlockedMs = 0.0; // total time the renderer waited on the encoder
+};
+
+class ProgressReporter {
+public:
+    ~ProgressReporter() {
+        if (fd >= 0 && ownsFd) ::close(fd);
+    }
+
+    // Writes must not block, but O_NONBLOCK set on the inherited fd would
+    // also apply to everything sharing its open file description, e.g. this
+    // process's own stdout for --progress-fd 1. A pipe or terminal is opened
+    // again through /proc as a description of our own; a socket is written
+    // with MSG_DONTWAIT. Anything else is only written when poll() says so.
+    bool openFd(int outFd, std::string& error) {
+        struct stat info;
+        if (fcntl(outFd, F_GETFD) == -1 || fstat(outFd, &info) != 0) {
+            error = "Progress fd " + std::to_string(outFd) + " is not open";
+            return false;
+        }
+        fd = outFd;
+        ownsFd = false;
+        socketFd = S_ISSOCK(info.st_mode);
+        nonBlocking = socketFd;
+        if (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode)) {
+            std::string path = "/proc/self/fd/" + std::to_string(outFd);
+            int own = ::open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (own >= 0) {
+                fd = own;
+                ownsFd = true;
+                nonBlocking = true;
+            }
+        }
+        return true;
+    }
+
+    // Connect to a listening SOCK_STREAM socket owned by the orchestrator
+    bool openUnixSocket(const std::string& path, std::string& error) {
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path)) {
+            error = "Progress socket path too long: " + path;
+            return false;
+        }
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) {
+            error = std::string("Failed to create progress socket: ") + strerror(errno);
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            error = "Failed to connect progress socket " + path + ": " + strerror(errno);
+            ::close(sock);
+            return false;
+        }
+        fd = sock;
+        ownsFd = true;
+        socketFd = true;
+        nonBlocking = true;
+        return true;
+    }
+
+    bool enabled() const { return fd >= 0; }
+
+    void setMinInterval(double seconds) { minInterval = seconds; }
+
+    // Start a job; resets rate and ETA estimates
+    void begin(const std::string& job, int totalFrames, int width, int height) {
+        jobName = escape(job);
+        start = std::chrono::steady_clock::now();
+        lastEmit = start - std::chrono::hours(1);
+        smoothedFps = 0.0;
+        // The name goes in outside the fixed buffer, which would truncate a long path
+        char fields[256];
+        snprintf(fields, sizeof(fields), "\"pid\":%d,\"total_frames\":%d,\"width\":%d,\"height\":%d}\n",
+                 static_cast<int>(getpid()), totalFrames, width, height);
+        emit("{\"event\":\"start\",\"job\":\"" + jobName + "\"," + fields);
+    }
+
+    // Record a finished frame; emits at most once per min interval.
+    // Returns true when a line was due (callers reuse it to pace console output).
+    bool update(const ProgressSample& s, const std::string& extraJson = "") {
+        double fps = s.frameSeconds > 0.0 ? 1.0 / s.frameSeconds : 0.0;
+        smoothedFps = smoothedFps == 0.0 ? fps : smoothedFps + kSmoothing * (fps - smoothedFps);
+        last = s;
+        auto now = std::chrono::steady_clock::now();
+        bool due = std::chrono::duration<double>(now - lastEmit).count() >= minInterval ||
+                   s.framesDone == s.totalFrames;
+        if (!due) return false;
+        lastEmit = now;
+        if (enabled()) emit(progressLine("progress", fps, extraJson));
+        return true;
+    }
+
+    // The render is over, so the last line may wait briefly for a slow reader
+    void finish(bool ok, const std::string& message) {
+        if (!enabled()) return;
+        std::string line = progressLine(ok ? "done" : "failed", 0.0, "\"message\":\"" + escape(message) + "\"");
+        waitWritable();
+        emit(line);
+        waitWritable();
+    }
+
+    double fpsSmoothed() const { return smoothedFps; }
+
+    double etaSeconds() const {
+        int remaining = last.totalFrames - last.framesDone;
+        return smoothedFps > 0.0 ? remaining / smoothedFps : 0.0;
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+                out += code;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+private:
+    static constexpr double kSmoothing = 0.1;
+    static constexpr int kFinishWaitMs = 500;
+
+    // Write without waiting for the reader (see openFd()); SIGPIPE is ignored
+    // by main(), so a vanished reader only makes writes fail
+    ssize_t writeSome(const char* data, size_t size) {
+        if (socketFd) return send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (!nonBlocking) {
+            pollfd entry{fd, POLLOUT, 0};
+            if (poll(&entry, 1, 0) != 1) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+        return write(fd, data, size);
+    }
+
+    std::string progressLine(const char* event, double fps, const std::string& extraJson) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        char line[768];
+        snprintf(line, sizeof(line),
+                 "\"pid\":%d,\"frame\":%d,\"total_frames\":%d,"
+                 "\"fps\":%.3f,\"fps_smoothed\":%.3f,\"elapsed_s\":%.3f,\"eta_s\":%.3f,"
+                 "\"queue_depth\":%d,\"queue_capacity\":%d,\"encoder_blocked_ms\":%.3f,"
+                 "\"encoder_backpressure\":%.4f,\"dropped_lines\":%ld",
+                 static_cast<int>(getpid()), last.framesDone, last.totalFrames,
+                 fps, smoothedFps, elapsed, etaSeconds(),
+                 last.queueDepth, last.queueCapacity, last.encoderBlockedMs,
+                 elapsed > 0.0 ? last.encoderBlockedMs / 1000.0 / elapsed : 0.0,
+                 droppedLines);
+        std::string out = std::string("{\"event\":\"") + event + "\",\"job\":\"" + jobName + "\"," + line;
+        if (!extraJson.empty()) out += "," + extraJson;
+        out += "}\n";
+        return out;
+    }
+
+    void emit(const std::string& line) {
+        if (fd < 0) return;
+        // Finish a line cut short earlier; until it is out, new lines are dropped
+        if (!flushPending()) {
+            if (fd >= 0) droppedLines++;
+            return;
+        }
+        pending = line;
+        if (!flushPending() && fd >= 0 && pending.size() == line.size()) {
+            // None of it was taken: drop the whole line
+            pending.clear();
+            droppedLines++;
+        }
+    }
+
+    // Give a line still pending up to kFinishWaitMs to go out
+    void waitWritable() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kFinishWaitMs);
+        while (fd >= 0 && !flushPending()) {
+            int left = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count());
+            pollfd entry{fd, POLLOUT, 0};
+            if (left <= 0 || poll(&entry, 1, left) <= 0) return;
+        }
+    }
+
+    // Write as much of the pending line as the channel takes; true once all of it is out
+    bool flushPending() {
+        while (!pending.empty()) {
+            ssize_t n = writeSome(pending.data(), pending.size());
+            if (n > 0) {
+                pending.erase(0, static_cast<size_t>(n));
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            } else {
+                fprintf(stderr, "Progress channel closed: %s\n", strerror(errno));
+                if (ownsFd) ::close(fd);
+                fd = -1;
+                pending.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int fd = -1;
+    bool ownsFd = false;
+    bool socketFd = false;     // written with send()
+    bool nonBlocking = false;  // writes return EAGAIN rather than wait
+    double minInterval = 0.5;
+    std::string jobName;
+    std::string pending;  // unsent tail of a partly written line
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point lastEmit;
+    double smoothedFps = 0.0;
+    ProgressSample last;
+    long droppedLines = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+// Off-screen color target (FBO + texture) whose memory is recorded in the
+// resource registry.
+#include "resources.h"
+#include <memory>
+#include <vector>
+
+// Upload format/type matching a sized internal format
+inline void textureFormatFor(GLenum internalFormat, GLenum& format, GLenum& type) {
+    switch (internalFormat) {
+        case GL_RGBA16F: format = GL_RGBA; type = GL_HALF_FLOAT; break;
+        case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; break;
+        case GL_R32F: format = GL_RED; type = GL_FLOAT; break;
+        case GL_RGBA8: format = GL_RGBA; type = GL_UNSIGNED_BYTE; break;
+        default: format = GL_RGB; type = GL_UNSIGNED_BYTE; break;
+    }
+}
+
+inline size_t estimateTargetBytes(int width, int height, GLenum internalFormat) {
+    return static_cast<size_t>(width) * height * bytesPerTexel(internalFormat);
+}
+
+struct RenderTarget {
+    GLuint fbo = 0;
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = GL_RGB8;
+
+    bool valid() const { return fbo != 0; }
+
+    bool create(int w, int h, GLenum format, const std::string& owner, std::string& error) {
+        destroy();
+        width = w;
+        height = h;
+        internalFormat = format;
+        GLenum uploadFormat, uploadType;
+        textureFormatFor(internalFormat, uploadFormat, uploadType);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, uploadFormat, uploadType, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            error = "Framebuffer incomplete (" + std::to_string(width) + "x" + std::to_string(height) + ") for " + owner;
+            destroy();
+            return false;
+        }
+        std::string size = std::to_string(width) + "x" + std::to_string(height);
+        ResourceRegistry::instance().track(ResourceKind::Texture, texture, estimateTargetBytes(width, height, internalFormat),
+                                           owner, "color " + size);
+        ResourceRegistry::instance().track(ResourceKind::Framebuffer, fbo, 0, owner, "fbo " + size);
+        return true;
+    }
+
+    void destroy() {
+        if (texture) {
+            ResourceRegistry::instance().release(ResourceKind::Texture, texture);
+            glDeleteTextures(1, &texture);
+        }
+        if (fbo) {
+            ResourceRegistry::instance().release(ResourceKind::Framebuffer, fbo);
+            glDeleteFramebuffers(1, &fbo);
+        }
+        texture = 0;
+        fbo = 0;
+    }
+};
+
+// Reusable render targets for sizes that change at run time (window resizes,
+// preview resolution changes). A request is served by any free target of the
+// format that is at least as large, and the caller draws into its lower-left
+// width x height; new allocations are rounded up so small resizes reuse them.
+class RenderTargetPool {
+public:
+    ~RenderTargetPool() { destroy(); }
+
+    RenderTarget* acquire(int width, int height, GLenum format, const std::string& owner, std::string& error) {
+        Slot* best = nullptr;
+        for (auto& slot : slots) {
+            const RenderTarget& t = slot->target;
+            if (slot->inUse || t.internalFormat != format || t.width < width || t.height < height) continue;
+            if (!best || static_cast<long long>(t.width) * t.height <
+                             static_cast<long long>(best->target.width) * best->target.height) {
+                best = slot.get();
+            }
+        }
+        if (!best) {
+            // Drop free targets of this format that are now too small
+            trim(format);
+            GLint maxSize = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+            int allocWidth = std::max(std::min(roundUp(width), static_cast<int>(maxSize)), width);
+            int allocHeight = std::max(std::min(roundUp(height), static_cast<int>(maxSize)), height);
+            auto slot = std::make_unique<Slot>();
+            if (!slot->target.create(allocWidth, allocHeight, format, owner, error)) return nullptr;
+            slots.push_back(std::move(slot));
+            best = slots.back().get();
+            allocationCount++;
+        }
+        best->inUse = true;
+        return &best->target;
+    }
+
+    void release(RenderTarget* target) {
+        for (auto& slot : slots) {
+            if (&slot->target == target) slot->inUse = false;
+        }
+    }
+
+    void destroy() {
+        for (auto& slot : slots) slot->target.destroy();
+        slots.clear();
+    }
+
+    int allocations() const { return allocationCount; }
+
+private:
+    struct Slot {
+        RenderTarget target;
+        bool inUse = false;
+    };
+
+    static int roundUp(int size) { return (size + kGranularity - 1) / kGranularity * kGranularity; }
+
+    void trim(GLenum format) {
+        for (auto it = slots.begin(); it != slots.end();) {
+            if (!(*it)->inUse && (*it)->target.internalFormat == format) {
+                (*it)->target.destroy();
+                it = slots.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static const int kGranularity = 256;
+    std::vector<std::unique_ptr<Slot>> slots;
+    int allocationCount = 0;
+};
@@ -0,0 +1,118 @@
+#pragma once
+// GPU downsampling pass: filters a larger rendered image (supersampled or
+// full-size) down to an output resolution before readback, so only output
+// sized pixels cross the bus. Box averages the source texels under each
+// output pixel; Lanczos-2 is sharper at the cost of more taps.
+//
+// Coordinates are global, so the source may be any sub-rectangle of the full
+// image (a tile plus an apron). Samples are clamped to the full image, which
+// makes tiled and untiled resolves produce identical pixels.
+#include "shader_utils.h"
+#include <cmath>
+
+enum class ResolveFilter { Box, Lanczos };
+
+inline const char* resolveFilterName(ResolveFilter filter) {
+    return filter == ResolveFilter::Lanczos ? "lanczos" : "box";
+}
+
+// Extra source pixels a region needs on each side so its filter taps are
+// rendered (scale = source pixels per output pixel)
+inline int resolveApron(float scale, ResolveFilter filter) {
+    if (filter == ResolveFilter::Box) return 0;
+    return static_cast<int>(std::ceil(2.0f * std::max(scale, 1.0f))) + 1;
+}
+
+inline const char* resolveFragmentShaderSource = R"(
+#version 330 core
+uniform sampler2D source;
+uniform vec2 scale;          // source pixels per output pixel
+uniform ivec2 sourceOrigin;  // global coordinate of the texture's texel (0, 0)
+uniform ivec2 sourceSize;    // full source image, taps are clamped to it
+uniform ivec2 outputOrigin;  // global coordinate of the viewport's lower-left pixel
+uniform int lanczos;
+out vec4 FragColor;
+
+float lanczos2(float x)
+{
+    x = abs(x);
+    if (x < 1e-5) return 1.0;
+    if (x >= 2.0) return 0.0;
+    float px = 3.14159265 * x;
+    return 2.0 * sin(px) * sin(px * 0.5) / (px * px);
+}
+
+void main()
+{
+    vec2 center = (floor(gl_FragCoord.xy) + vec2(outputOrigin) + 0.5) * scale;
+    vec2 footprint = max(scale, vec2(1.0));
+    vec2 support = (lanczos != 0 ? 2.0 : 0.5) * footprint;
+    ivec2 lo = ivec2(floor(center - support));
+    ivec2 hi = ivec2(ceil(center + support));
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int y = lo.y; y < hi.y; ++y) {
+        for (int x = lo.x; x < hi.x; ++x) {
+            vec2 d = (vec2(x, y) + 0.5 - center) / footprint;
+            float w = lanczos != 0 ? lanczos2(d.x) * lanczos2(d.y)
+                                   : ((abs(d.x) < 0.5 && abs(d.y) < 0.5) ? 1.0 : 0.0);
+            if (w == 0.0) continue;
+            ivec2 p = clamp(ivec2(x, y), ivec2(0), sourceSize - 1);
+            sum += w * texelFetch(source, p - sourceOrigin, 0).rgb;
+            weightSum += w;
+        }
+    }
+    FragColor = vec4(weightSum > 0.0 ? sum / weightSum : vec3(0.0), 1.0);
+}
+)";
+
+class ResolvePass {
+public:
+    bool init(std::string& error) {
+        if (program) return true;
+        if (!buildShaderProgram(resolveFragmentShaderSource, program, error)) {
+            program = 0;
+            return false;
+        }
+        scaleLoc = glGetUniformLocation(program, "scale");
+        sourceOriginLoc = glGetUniformLocation(program, "sourceOrigin");
+        sourceSizeLoc = glGetUniformLocation(program, "sourceSize");
+        outputOriginLoc = glGetUniformLocation(program, "outputOrigin");
+        lanczosLoc = glGetUniformLocation(program, "lanczos");
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "source"), 0);
+        glUseProgram(0);
+        return true;
+    }
+
+    void destroy() {
+        if (program) glDeleteProgram(program);
+        program = 0;
+    }
+
+    // Filter `texture` (holding global source pixels from sourceX/sourceY on)
+    // into the bound framebuffer's viewport, whose lower-left pixel is global
+    // output pixel (outputX, outputY). Expects the full-screen quad VAO bound.
+    void apply(GLuint texture, int sourceX, int sourceY, int sourceWidth, int sourceHeight,
+               float scaleX, float scaleY, int outputX, int outputY, ResolveFilter filter) {
+        TRACE_ZONE("resolve");
+        glUseProgram(program);
+        glUniform2f(scaleLoc, scaleX, scaleY);
+        glUniform2i(sourceOriginLoc, sourceX, sourceY);
+        glUniform2i(sourceSizeLoc, sourceWidth, sourceHeight);
+        glUniform2i(outputOriginLoc, outputX, outputY);
+        glUniform1i(lanczosLoc, filter == ResolveFilter::Lanczos ? 1 : 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+private:
+    GLuint program = 0;
+    GLint scaleLoc = -1;
+    GLint sourceOriginLoc = -1;
+    GLint sourceSizeLoc = -1;
+    GLint outputOriginLoc = -1;
+    GLint lanczosLoc = -1;
+};
@@ -0,0 +1,181 @@
+#pragma once
+// Registry of GPU and large host allocations (size and owner of every
+// texture, buffer, framebuffer and frame-sized host buffer) with memory
+// budgets, so jobs can be checked against the budget before they allocate.
+#include "glad/glad.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum class ResourceKind { Texture, Buffer, Framebuffer, Renderbuffer, HostBuffer };
+
+inline const char* resourceKindName(ResourceKind kind) {
+    switch (kind) {
+        case ResourceKind::Texture: return "texture";
+        case ResourceKind::Buffer: return "buffer";
+        case ResourceKind::Framebuffer: return "framebuffer";
+        case ResourceKind::Renderbuffer: return "renderbuffer";
+        case ResourceKind::HostBuffer: return "host";
+    }
+    return "?";
+}
+
+struct ResourceEntry {
+    ResourceKind kind;
+    uint64_t id;
+    size_t bytes;
+    std::string owner;
+    std::string label;
+};
+
+class ResourceRegistry {
+public:
+    static ResourceRegistry& instance() {
+        static ResourceRegistry registry;
+        return registry;
+    }
+
+    // GL objects are keyed by their name; host buffers by address
+    void track(ResourceKind kind, uint64_t id, size_t bytes, const std::string& owner, const std::string& label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& entry = entries[key(kind, id)];
+        if (entry.bytes) total(entry.kind) -= entry.bytes;
+        entry = ResourceEntry{kind, id, bytes, owner, label};
+        total(kind) += bytes;
+        peak(kind) = std::max(peak(kind), total(kind));
+    }
+
+    void release(ResourceKind kind, uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key(kind, id));
+        if (it == entries.end()) return;
+        total(kind) -= it->second.bytes;
+        entries.erase(it);
+    }
+
+    size_t gpuBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return gpuTotal;
+    }
+
+    size_t hostBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hostTotal;
+    }
+
+    size_t gpuPeak() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return gpuHighWater;
+    }
+
+    size_t hostPeak() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hostHighWater;
+    }
+
+    std::vector<ResourceEntry> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<ResourceEntry> list;
+        for (const auto& kv : entries) list.push_back(kv.second);
+        std::sort(list.begin(), list.end(),
+                  [](const ResourceEntry& a, const ResourceEntry& b) { return a.bytes > b.bytes; });
+        return list;
+    }
+
+    size_t gpuBudget = 0;   // bytes, 0 = unlimited
+    size_t hostBudget = 0;
+
+    // Would allocating the extra bytes stay within both budgets?
+    bool fits(size_t extraGpu, size_t extraHost, std::string& reason) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream oss;
+        if (gpuBudget && gpuTotal + extraGpu > gpuBudget) {
+            oss << "GPU memory " << toMB(gpuTotal) << " MB in use + " << toMB(extraGpu)
+                << " MB needed exceeds budget " << toMB(gpuBudget) << " MB";
+        } else if (hostBudget && hostTotal + extraHost > hostBudget) {
+            oss << "Host memory " << toMB(hostTotal) << " MB in use + " << toMB(extraHost)
+                << " MB needed exceeds budget " << toMB(hostBudget) << " MB";
+        } else {
+            return true;
+        }
+        reason = oss.str();
+        return false;
+    }
+
+    static double toMB(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+private:
+    static uint64_t key(ResourceKind kind, uint64_t id) {
+        // Host buffer addresses never collide with small GL names in practice,
+        // but keep the kinds apart anyway
+        return (id << 3) | static_cast<uint64_t>(kind);
+    }
+
+    static bool isHost(ResourceKind kind) { return kind == ResourceKind::HostBuffer; }
+    size_t& total(ResourceKind kind) { return isHost(kind) ? hostTotal : gpuTotal; }
+    size_t& peak(ResourceKind kind) { return isHost(kind) ? hostHighWater : gpuHighWater; }
+
+    std::mutex mutex;
+    std::map<uint64_t, ResourceEntry> entries;
+    size_t gpuTotal = 0;
+    size_t hostTotal = 0;
+    size_t gpuHighWater = 0;
+    size_t hostHighWater = 0;
+};
+
+// Bytes per texel as drivers typically store them (RGB8 is padded to RGBA8)
+inline size_t bytesPerTexel(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_RGBA16F: return 8;
+        case GL_RGBA16: return 8;
+        case GL_RGBA32F: return 16;
+        case GL_R32F: return 4;
+        default: return 4;
+    }
+}
+
+inline void trackHostBuffer(const void* data, size_t bytes, const std::string& owner, const std::string& label) {
+    ResourceRegistry::instance().track(ResourceKind::HostBuffer, reinterpret_cast<uintptr_t>(data), bytes, owner, label);
+}
+
+inline void releaseHostBuffer(const void* data) {
+    ResourceRegistry::instance().release(ResourceKind::HostBuffer, reinterpret_cast<uintptr_t>(data));
+}
+
+// Physical memory the kernel reports as available (0 if unknown)
+inline size_t availableHostMemory() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t kb;
+    std::string unit;
+    while (meminfo >> key >> kb >> unit) {
+        if (key == "MemAvailable:") return kb * 1024;
+    }
+    return 0;
+}
+
+// Dedicated video memory from vendor extensions (0 if the driver does not say)
+inline size_t availableGpuMemory() {
+    const GLenum GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX = 0x9047;
+    const GLenum TEXTURE_FREE_MEMORY_ATI = 0x87FC;
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; ++i) {
+        std::string ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        GLint kb[4] = {0, 0, 0, 0};
+        if (ext == "GL_NVX_gpu_memory_info") {
+            glGetIntegerv(GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, kb);
+            return static_cast<size_t>(kb[0]) * 1024;
+        }
+        if (ext == "GL_ATI_meminfo") {
+            glGetIntegerv(TEXTURE_FREE_MEMORY_ATI, kb);
+            return static_cast<size_t>(kb[0]) * 1024;
+        }
+    }
+    return 0;
+}
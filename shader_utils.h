@@ -0,0 +1,220 @@
+#pragma once
+// Shader loading, compilation and the full-screen quad shared by the preview
+// app and the headless benchmark.
+#include "glad/glad.h"
+#include "trace.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+
+// Vertex shader
+inline const char* vertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+uniform vec4 uvTransform; // xy: offset, zw: scale of fragUV (sub-rectangle for tiled draws)
+out vec2 fragUV;
+void main()
+{
+    gl_Position = vec4(aPosition, 1.0);
+    fragUV = uvTransform.xy + aTexCoord * uvTransform.zw;
+}
+)";
+
+// Fallback fragment shader (solid red for debugging)
+inline const char* fallbackFragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(1.0, 0.0, 0.0, 1.0); // Red color
+}
+)";
+
+// Compile shader with error checking
+inline bool compileShader(GLenum type, const char* source, GLuint& shader, std::string& error) {
+    TRACE_ZONE("compileShader");
+    shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        error = "Shader compilation failed (" +
+                std::string(type == GL_VERTEX_SHADER ? "vertex" : "fragment") +
+                "):\n" + infoLog;
+        glDeleteShader(shader);
+        return false;
+    }
+    return true;
+}
+
+// Link program with error checking
+inline bool linkProgram(GLuint vertShader, GLuint fragShader, GLuint& program, std::string& error) {
+    TRACE_ZONE("linkProgram");
+    program = glCreateProgram();
+    glAttachShader(program, vertShader);
+    glAttachShader(program, fragShader);
+    glLinkProgram(program);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        error = "Program linking failed:\n" + std::string(infoLog);
+        glDeleteProgram(program);
+        return false;
+    }
+    // Untiled draws cover the whole image: identity uv transform, no pixel offset
+    glUseProgram(program);
+    GLint uvLoc = glGetUniformLocation(program, "uvTransform");
+    if (uvLoc != -1) glUniform4f(uvLoc, 0.0f, 0.0f, 1.0f, 1.0f);
+    glUseProgram(0);
+    glValidateProgram(program);
+    glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        error = "Program validation failed:\n" + std::string(infoLog);
+        glDeleteProgram(program);
+        return false;
+    }
+    return true;
+}
+
+// Read a shader source without logging (library scans touch many files)
+inline bool readShaderSource(const std::string& filepath, std::string& content, std::string& error) {
+    std::ifstream file(filepath);
+    if (!file.is_open()) {
+        error = "Failed to open shader file: " + filepath;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    if (content.empty()) {
+        error = "Shader file is empty: " + filepath;
+        return false;
+    }
+    return true;
+}
+
+// Load shader from file
+inline std::string loadShaderFile(const std::string& filepath, std::string& error) {
+    TRACE_ZONE("loadShaderFile");
+    std::string content;
+    if (!readShaderSource(filepath, content, error)) {
+        std::cerr << error << "\n";
+        return "";
+    }
+    std::cerr << "Loaded shader: " << filepath << ", size: " << content.size() << " bytes\n";
+    return content;
+}
+
+// Inject iTileOffset into a fragment shader: every gl_FragCoord read becomes
+// gl_FragCoord + iTileOffset, so a shader drawn into a sub-rectangle (tile)
+// still sees global pixel coordinates consistent with iResolution.
+inline std::string expandShaderSource(const std::string& source) {
+    // Insert after #version / #extension lines, which must come first
+    size_t insertAt = 0;
+    int line = 1;
+    while (insertAt < source.size()) {
+        size_t end = source.find('\n', insertAt);
+        size_t next = end == std::string::npos ? source.size() : end + 1;
+        std::string text = source.substr(insertAt, next - insertAt);
+        size_t first = text.find_first_not_of(" \t\r\n");
+        bool header = first == std::string::npos || text.compare(first, 2, "//") == 0 ||
+                      text.compare(first, 8, "#version") == 0 || text.compare(first, 10, "#extension") == 0;
+        if (!header) break;
+        insertAt = next;
+        line++;
+    }
+
+    const std::string name = "gl_FragCoord";
+    std::string body;
+    size_t pos = insertAt;
+    auto isIdent = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    for (size_t found; (found = source.find(name, pos)) != std::string::npos; pos = found + name.size()) {
+        body.append(source, pos, found - pos);
+        bool whole = (found == 0 || !isIdent(source[found - 1])) &&
+                     (found + name.size() >= source.size() || !isIdent(source[found + name.size()]));
+        body += whole ? "glslstudio_FragCoord()" : name;
+    }
+    body.append(source, pos, std::string::npos);
+
+    return source.substr(0, insertAt) +
+           "uniform vec2 iTileOffset;\n"
+           "vec4 glslstudio_FragCoord() { return vec4(gl_FragCoord.xy + iTileOffset, gl_FragCoord.zw); }\n"
+           "#line " + std::to_string(line) + "\n" + body;
+}
+
+// Load all shader files from directory
+inline std::vector<std::string> loadShaderFiles(const std::string& directory, std::string& error) {
+    TRACE_ZONE("loadShaderFiles");
+    std::vector<std::string> shaderFiles;
+    try {
+        if (!std::filesystem::exists(directory)) {
+            error = "Shader directory does not exist: " + directory;
+            std::cerr << error << "\n";
+            return shaderFiles;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            if (ext == ".txt") shaderFiles.push_back(entry.path().string());
+        }
+        if (shaderFiles.empty()) {
+            error = "No .txt shader files found in directory: " + directory;
+            std::cerr << error << "\n";
+        }
+    } catch (const std::exception& e) {
+        error = "Error reading shader directory: " + std::string(e.what());
+        std::cerr << error << "\n";
+    }
+    return shaderFiles;
+}
+
+// Compile the shared vertex shader with a fragment source and link them
+inline bool buildShaderProgram(const std::string& fragSource, GLuint& program, std::string& error) {
+    GLuint vertShader, fragShader;
+    if (!compileShader(GL_VERTEX_SHADER, vertexShaderSource, vertShader, error)) return false;
+    if (!compileShader(GL_FRAGMENT_SHADER, fragSource.c_str(), fragShader, error)) {
+        glDeleteShader(vertShader);
+        return false;
+    }
+    bool linked = linkProgram(vertShader, fragShader, program, error);
+    glDeleteShader(vertShader);
+    glDeleteShader(fragShader);
+    return linked;
+}
+
+// Setup full-screen quad (two triangles, position + uv)
+inline void createFullscreenQuad(GLuint& VAO, GLuint& VBO) {
+    float quadVertices[] = {
+        -1.0f,  1.0f, 0.0f,  0.0f, 1.0f,
+        -1.0f, -1.0f, 0.0f,  0.0f, 0.0f,
+         1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f,  0.0f, 1.0f,
+         1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
+         1.0f,  1.0f, 0.0f,  1.0f, 1.0f
+    };
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
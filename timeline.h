@@ -0,0 +1,211 @@
+#pragma once
+// Low-resolution frame cache behind the timeline slider. The clip is divided
+// into slots (framesPerSecond per second of iTime); fill() renders missing
+// slots at a small size, nearest to the playhead first, within a GPU time
+// budget per loop iteration (frames per call follow the measured GPU cost of
+// a frame). Scrubbing over cached slots then shows the stored frame
+// instead of drawing the shader at full resolution.
+//
+// The cache holds at most budgetMB of frames. Filling only targets the slots
+// nearest the playhead that fit in the budget; a new frame takes the target
+// of the least recently used frame outside that window, so a scrub that moves
+// away gradually replaces the frames it left behind.
+#include "gpu_timer.h"
+#include "render_target.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+class TimelineCache {
+public:
+    bool enabled = true;
+    int budgetMB = 128;
+    int frameWidth = 480;            // height follows the preview aspect ratio
+    float framesPerSecond = 30.0f;   // slots per second of iTime
+    double fillBudgetMs = 4.0;       // GPU (and CPU) time per fill() call; at least one frame is drawn
+
+    // Clip length and aspect ratio; any change empties the cache
+    void configure(float clipSeconds, int aspectWidth, int aspectHeight) {
+        int slots = std::max(1, static_cast<int>(std::ceil(clipSeconds * framesPerSecond)) + 1);
+        int height = std::max(1, frameWidth * aspectHeight / std::max(aspectWidth, 1));
+        if (slots == slotCount && height == frameHeight && clipSeconds == clipLength) return;
+        clear();
+        slotCount = slots;
+        frameHeight = height;
+        clipLength = clipSeconds;
+    }
+
+    // Drop every frame (shader changed); targets are kept for reuse
+    void clear() {
+        for (auto& entry : frames) spare.push_back(entry.second.target);
+        frames.clear();
+        frameCostMs = -1.0;
+    }
+
+    int slotOf(float time) const {
+        int slot = static_cast<int>(std::lround(time * framesPerSecond));
+        return std::min(std::max(slot, 0), slotCount - 1);
+    }
+
+    float timeOf(int slot) const { return slot / framesPerSecond; }
+
+    // Cached frame for the slot nearest `time`, or null
+    const RenderTarget* lookup(float time) {
+        auto it = frames.find(slotOf(time));
+        if (it == frames.end()) return nullptr;
+        it->second.lastUse = ++useCounter;
+        return &it->second.target;
+    }
+
+    // Render missing slots around `playhead` with `program` until the budget is
+    // spent. Draws are only submitted here, so the number of frames is capped
+    // by their measured GPU cost; until one is known, one frame per call.
+    // Returns false if a frame target could not be allocated.
+    bool fill(GLuint program, GLuint vao, float playhead, std::string& error) {
+        collectCost();
+        if (!enabled || !program || slotCount == 0 || complete(playhead)) return true;
+        TRACE_ZONE("timeline fill");
+        auto start = std::chrono::steady_clock::now();
+        int maxFrames = 1;
+        if (frameCostMs >= 0.0) {
+            maxFrames = std::max(1, static_cast<int>(std::min(fillBudgetMs / std::max(frameCostMs, 0.001), 100000.0)));
+        }
+        bool timed = batchFrames.size() < TIMER_SLOTS;
+        if (!timerReady) {
+            timer.init();
+            timerReady = true;
+        }
+        GLint iTimeLoc = glGetUniformLocation(program, "iTime");
+        GLint iResLoc = glGetUniformLocation(program, "iResolution");
+        glUseProgram(program);
+        if (iResLoc != -1) glUniform3f(iResLoc, static_cast<float>(frameWidth), static_cast<float>(frameHeight), 1.0f);
+        glBindVertexArray(vao);
+        glViewport(0, 0, frameWidth, frameHeight);
+        if (timed) timer.begin();
+        bool ok = true;
+        int drawn = 0;
+        do {
+            int slot = nextMissing(playhead);
+            if (slot < 0) break;
+            RenderTarget target;
+            if (!takeTarget(playhead, target, error)) {
+                ok = false;
+                break;
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+            if (iTimeLoc != -1) glUniform1f(iTimeLoc, timeOf(slot));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            frames[slot] = Frame{target, ++useCounter};
+            drawn++;
+        } while (drawn < maxFrames &&
+                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < fillBudgetMs);
+        if (timed) {
+            timer.end();
+            batchFrames.push_back(std::max(drawn, 1));
+        }
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return ok;
+    }
+
+    // Every slot of the window around the playhead is cached
+    bool complete(float playhead) const { return nextMissing(playhead) < 0; }
+
+    int capacity() const {
+        size_t frameBytes = estimateTargetBytes(frameWidth, std::max(frameHeight, 1), GL_RGB8);
+        return std::max(1, static_cast<int>(static_cast<size_t>(budgetMB) * 1024 * 1024 / frameBytes));
+    }
+
+    int cachedFrames() const { return static_cast<int>(frames.size()); }
+    int slots() const { return slotCount; }
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+    bool cached(int slot) const { return frames.count(slot) != 0; }
+
+    void destroy() {
+        clear();
+        for (auto& target : spare) target.destroy();
+        spare.clear();
+        if (timerReady) timer.destroy();
+        timerReady = false;
+        batchFrames.clear();
+    }
+
+private:
+    struct Frame {
+        RenderTarget target;
+        uint64_t lastUse = 0;
+    };
+
+    static const size_t TIMER_SLOTS = 4;
+
+    // Per-frame GPU cost of the latest fill() batch that has finished
+    void collectCost() {
+        double ms = 0.0;
+        while (timerReady && timer.poll(ms)) {
+            frameCostMs = ms / batchFrames.front();
+            batchFrames.pop_front();
+        }
+    }
+
+    // Slots the cache tries to hold: as many as fit in the budget, centred on
+    // the playhead and shifted inside the clip at its ends
+    void window(float playhead, int& first, int& last) const {
+        int size = std::min(capacity(), slotCount);
+        first = std::min(std::max(slotOf(playhead) - size / 2, 0), slotCount - size);
+        last = first + size - 1;
+    }
+
+    // Missing slot of the window nearest the playhead, or -1
+    int nextMissing(float playhead) const {
+        int first, last;
+        window(playhead, first, last);
+        int center = slotOf(playhead);
+        for (int offset = 0; center - offset >= first || center + offset <= last; ++offset) {
+            if (center + offset <= last && !frames.count(center + offset)) return center + offset;
+            if (offset > 0 && center - offset >= first && !frames.count(center - offset)) return center - offset;
+        }
+        return -1;
+    }
+
+    // A spare target, a new one under the budget, or the least recently used
+    // frame outside the playhead's window
+    bool takeTarget(float playhead, RenderTarget& target, std::string& error) {
+        while (!spare.empty()) {
+            target = spare.back();
+            spare.pop_back();
+            if (target.width == frameWidth && target.height == frameHeight) return true;
+            target.destroy();
+        }
+        if (cachedFrames() < capacity()) {
+            return target.create(frameWidth, frameHeight, GL_RGB8, "timeline cache", error);
+        }
+        int first, last;
+        window(playhead, first, last);
+        auto victim = frames.end();
+        for (auto it = frames.begin(); it != frames.end(); ++it) {
+            if (it->first >= first && it->first <= last) continue;
+            if (victim == frames.end() || it->second.lastUse < victim->second.lastUse) victim = it;
+        }
+        if (victim == frames.end()) {
+            error = "Timeline cache window holds no evictable frame";
+            return false;
+        }
+        target = victim->second.target;
+        frames.erase(victim);
+        return true;
+    }
+
+    std::unordered_map<int, Frame> frames;
+    std::vector<RenderTarget> spare;
+    int slotCount = 0;
+    int frameHeight = 0;
+    float clipLength = -1.0f;
+    uint64_t useCounter = 0;
+    GpuTimer timer{static_cast<int>(TIMER_SLOTS)};
+    bool timerReady = false;
+    std::deque<int> batchFrames;  // frames drawn by each fill() batch still being timed
+    double frameCostMs = -1.0;    // GPU time of one frame, negative until measured
+};
@@ -0,0 +1,172 @@
+#pragma once
+// Scoped stage tracer that dumps Chrome trace JSON (open in ui.perfetto.dev
+// or chrome://tracing). Each thread records into its own fixed-size buffer,
+// so TRACE_ZONE never takes a lock; when tracing is disabled a zone costs one
+// relaxed atomic load. A thread's buffer goes back to the registry when the
+// thread exits and is reused by the next new thread, so short-lived workers
+// (segment feeders, PNG writers) share a few buffers and trace rows.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace trace {
+
+struct Event {
+    const char* name;   // must be a string literal (stored by pointer)
+    int64_t startNs;
+    int64_t durationNs;
+};
+
+// Single-producer event buffer owned by one thread at a time. The owner
+// publishes events by bumping `count` with release order; the dumper reads
+// with acquire. Events are left uninitialised, so pages are only committed as
+// they are written.
+struct ThreadBuffer {
+    static const size_t kCapacity = 1 << 16;
+    std::unique_ptr<Event[]> events{new Event[kCapacity]};
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+    int tid = 0;
+    bool owned = true;               // held by a running thread (registry mutex)
+    std::vector<std::string> names;  // threads that recorded here (registry mutex)
+};
+
+struct Registry {
+    std::atomic<bool> enabled{false};
+    std::mutex mutex;  // only guards buffer registration and dumping
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline bool enabled() { return registry().enabled.load(std::memory_order_relaxed); }
+
+inline void setEnabled(bool on) { registry().enabled.store(on, std::memory_order_relaxed); }
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - registry().epoch).count();
+}
+
+// Hands the thread's buffer back to the registry when the thread exits
+struct ThreadSlot {
+    ThreadBuffer* buffer = nullptr;
+    ~ThreadSlot() {
+        if (!buffer) return;
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer->owned = false;
+    }
+};
+
+// Buffer for the calling thread: one an exited thread left with room to
+// spare, or a new one
+inline ThreadBuffer* threadBuffer() {
+    thread_local ThreadSlot slot;
+    if (!slot.buffer) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto& buffer : r.buffers) {
+            if (!buffer->owned && buffer->count.load(std::memory_order_relaxed) < ThreadBuffer::kCapacity) {
+                slot.buffer = buffer.get();
+                break;
+            }
+        }
+        if (!slot.buffer) {
+            r.buffers.emplace_back(new ThreadBuffer());
+            slot.buffer = r.buffers.back().get();
+            slot.buffer->tid = static_cast<int>(r.buffers.size());
+        }
+        slot.buffer->owned = true;
+    }
+    return slot.buffer;
+}
+
+// Label the calling thread in the trace viewer; a reused buffer's row lists
+// every name recorded on it
+inline void setThreadName(const std::string& name) {
+    if (!enabled()) return;
+    ThreadBuffer* buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    if (std::find(buffer->names.begin(), buffer->names.end(), name) == buffer->names.end()) {
+        buffer->names.push_back(name);
+    }
+}
+
+inline void record(const char* name, int64_t startNs, int64_t endNs) {
+    ThreadBuffer* buffer = threadBuffer();
+    size_t index = buffer->count.load(std::memory_order_relaxed);
+    if (index >= ThreadBuffer::kCapacity) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[index] = Event{name, startNs, endNs - startNs};
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+class Zone {
+public:
+    explicit Zone(const char* name) : name(enabled() ? name : nullptr) {
+        if (this->name) start = nowNs();
+    }
+    ~Zone() {
+        if (name) record(name, start, nowNs());
+    }
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    const char* name;
+    int64_t start = 0;
+};
+
+// Write every recorded event as Chrome trace JSON ("X" complete events)
+inline bool dump(const std::string& path, std::string& error) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        error = "Failed to open trace file: " + path;
+        return false;
+    }
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    size_t dropped = 0;
+    for (const auto& buffer : r.buffers) {
+        std::string threadName;
+        for (const std::string& name : buffer->names) threadName += (threadName.empty() ? "" : " / ") + name;
+        if (threadName.empty()) threadName = buffer->tid == 1 ? "main" : "thread " + std::to_string(buffer->tid);
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid, threadName.c_str());
+        first = false;
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            const Event& e = buffer->events[i];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    e.name, buffer->tid, e.startNs / 1000.0, e.durationNs / 1000.0);
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    if (dropped > 0) {
+        error = "Trace buffers full, dropped " + std::to_string(dropped) + " events";
+    }
+    return true;
+}
+
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) trace::Zone TRACE_CONCAT(traceZone_, __LINE__)(name)